@@ -32,6 +32,30 @@
   "binary-bal.rep",\
   "binary2-bal.rep"
 
+/*
+ * These realloc-heavy tracefiles in TRACEDIR are run after the default
+ * ones when no -f is given. They are reported in a table of their own
+ * and do not count toward the performance index.
+ */
+#define REALLOC_TRACEFILES \
+  "realloc-bal.rep",\
+  "realloc2-bal.rep"
+
+/*
+ * These calloc-heavy tracefiles in TRACEDIR are run after the realloc
+ * ones, checked for zeroed blocks, and reported in a table of their
+ * own that does not count toward the performance index either.
+ */
+#define CALLOC_TRACEFILES \
+  "calloc-bal.rep"
+
+/*
+ * These tracefiles in TRACEDIR ask for blocks of larger alignments
+ * and are reported after the calloc ones in the same way.
+ */
+#define MEMALIGN_TRACEFILES \
+  "memalign-bal.rep"
+
 /*
  * This constant gives the estimated performance of the libc malloc
  * package using our traces on some reference system, typically the
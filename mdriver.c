@@ -17,6 +17,13 @@
 #include <math.h>
 #include <inttypes.h>
 #include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
@@ -32,9 +39,12 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define BENCH_ROUNDS  20 /* times each -T thread replays the tracefiles */
+#define PIPE_SLOTS  1024 /* blocks in flight between a -P producer and consumer */
+#define BEST_TRIALS    5 /* timings of each way in -B, -S and -p, of which the best counts */
 
-/* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
+/* Returns true if p is align-byte aligned */
+#define IS_ALIGNED(p, align)  ((((uintptr_t)(p)) % (align)) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -49,9 +59,10 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    int size;                         /* byte size of alloc/realloc/calloc/memalign request */
+    int align;                        /* alignment of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -73,8 +84,27 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    void **batch;    /* room for a batch of pointers, for the -B runs */
 } speed_t;
 
+#ifdef MM_THREADS
+/* Holds the params to one thread of the -T scaling benchmark */
+typedef struct {
+    trace_t **traces;    /* the tracefiles to replay */
+    int num_traces;      /* number of tracefiles */
+    char **blocks;       /* this thread's own ptrs, one per alloc id */
+} bench_t;
+
+/* A producer/consumer pair of the -P remote free benchmark */
+typedef struct {
+    size_t *sizes;       /* the alloc sizes of the tracefiles */
+    int num_sizes;       /* number of sizes */
+    char *slots[PIPE_SLOTS]; /* ring of blocks from producer to consumer */
+    unsigned long head;  /* slots taken by the consumer */
+    unsigned long tail;  /* slots filled by the producer */
+} pipe_t;
+#endif
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -87,6 +117,11 @@ typedef struct {
 
     double inst_util;     /* instanteous space utilization for this trace (always 0 for libc) */
 
+    int reallocs;    /* number of realloc requests in the trace */
+    int inplace;     /* how many of them mm_realloc resized in place */
+    int callocs;     /* number of calloc requests in the trace */
+    int memaligns;   /* number of memalign requests in the trace */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
@@ -95,6 +130,11 @@ typedef struct {
  *******************/
 int verbose = 2;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int check_full = 1;    /* mm_check walks the whole heap every this many calls (-i) */
+static double check_secs = 0; /* seconds the mm correctness runs took, checks included */
+static long sample_bytes = 0; /* mean bytes between heap profile samples (-p) */
+static int counters = 0;      /* print the allocator counters per trace (-c) */
+static mm_stats_t util_counters; /* mm_get_stats at the end of the last utilization run */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -105,13 +145,28 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* The filenames of the realloc tracefiles, reported separately */
+static char *realloc_tracefiles[] = {  
+    REALLOC_TRACEFILES, NULL
+};
+
+/* The filenames of the calloc tracefiles, reported separately */
+static char *calloc_tracefiles[] = {  
+    CALLOC_TRACEFILES, NULL
+};
+
+/* The filenames of the memalign tracefiles, reported separately */
+static char *memalign_tracefiles[] = {  
+    MEMALIGN_TRACEFILES, NULL
+};
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, int size, int align,
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
@@ -127,8 +182,32 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int checks, int chaos);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio,
+                           int *inplace);
 static void eval_mm_speed(void *ptr);
+static void bench_huge(char *tracedir, char **tracefiles, int num_tracefiles);
+static int replay_batched(trace_t *trace, void **batch);
+static void eval_mm_batch_speed(void *ptr);
+static void bench_batch(char *tracedir, char **tracefiles, int num_tracefiles);
+static void replay_sized(trace_t *trace);
+static void eval_mm_sized_speed(void *ptr);
+static void bench_sized(char *tracedir, char **tracefiles, int num_tracefiles);
+static void replay_sampled(trace_t *trace, int num_ops);
+static void eval_mm_sampled_speed(void *ptr);
+static void bench_sample(char *tracedir, char **tracefiles, int num_tracefiles);
+static void eval_mm_ordered_speed(void *ptr);
+static void bench_order(char *tracedir, char **tracefiles, int num_tracefiles);
+static void replay_region(trace_t *trace, mm_region_t *r);
+static void eval_mm_region_speed(void *ptr);
+static void bench_region(char *tracedir, char **tracefiles, int num_tracefiles);
+static void best_secs(fsecs_test_funct f0, fsecs_test_funct f1, void *argp,
+                      double *secs);
+#ifdef MM_THREADS
+static void bench_threads(char *tracedir, char **tracefiles, int num_tracefiles,
+                          int max_threads);
+static void bench_pipes(char *tracedir, char **tracefiles, int num_tracefiles,
+                        int pairs);
+#endif
 
 /* Various helper routines */
 static int check(int chaos, const char *what);
@@ -136,6 +215,12 @@ static int check_free(int chaos, void *p);
 static void check_post_free(int chaos, void *p);
 static void mangle(void);
 static void printresults(int n, stats_t *stats);
+static void printreallocresults(int n, char **tracefiles, stats_t *stats);
+static void printcallocresults(int n, char **tracefiles, stats_t *stats);
+static void printmemalignresults(int n, char **tracefiles, stats_t *stats);
+static void printcounters(char *tracefile, mm_stats_t *stats);
+static int eval_mm_trace(char *tracedir, char *tracefile, int tracenum, stats_t *stats,
+                         range_t **ranges, range_t **d_ranges, int checks, int repeats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -146,21 +231,36 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-  int i, j;
+  int i;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
-    range_t *d_ranges = NULL;  
+    range_t *d_ranges = NULL;  /* range list for the chaos runs */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *realloc_stats = NULL; /* mm stats for each realloc trace */
+    int num_realloc_tracefiles = 0;
+    stats_t *calloc_stats = NULL; /* mm stats for each calloc trace */
+    int num_calloc_tracefiles = 0;
+    stats_t *memalign_stats = NULL; /* mm stats for each memalign trace */
+    int num_memalign_tracefiles = 0;
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
     int checks = 1;      /* Whether to use mm_check and mm_can_free */
     int repeats = 1;     /* Number of times to try random chaos */
+    int huge = 0;        /* If set, compare plain and huge page mappings (-H) */
+    int batch = 0;       /* If set, compare single and batched calls (-B) */
+    int sized = 0;       /* If set, compare plain and sized frees (-S) */
+    int order = 0;       /* If set, compare LIFO and address-ordered bins (-O) */
+    int region = 0;      /* If set, compare single frees and region destroys (-R) */
+#ifdef MM_THREADS
+    int threads = 0;     /* If set, run the scaling benchmark up to this many threads (-T) */
+    int pairs = 0;       /* If set, run the remote free benchmark with this many pairs (-P) */
+#endif
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, inst_util, avg_mm_inst_util, avg_mm_util, avg_mm_throughput;
@@ -172,7 +272,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "s:r:f:t:hqgaln")) != EOF) {
+    while ((c = getopt(argc, argv, "s:r:f:t:i:p:T:P:HBSORchqgaln")) != EOF) {
         switch (c) {
         case 's':
             srandom(atoi(optarg));
@@ -183,6 +283,11 @@ int main(int argc, char **argv)
         case 'n':
             checks = 0;
             break;
+        case 'i':
+            check_full = atoi(optarg);
+            if (check_full < 1)
+                app_error("-i needs a count of at least 1");
+            break;
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
@@ -201,6 +306,43 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'T': /* Run the thread scaling benchmark instead */
+#ifdef MM_THREADS
+            threads = atoi(optarg);
+            break;
+#else
+            app_error("-T needs the thread-safe driver, see make mdriver-mt");
+#endif
+        case 'P': /* Run the remote free benchmark instead */
+#ifdef MM_THREADS
+            pairs = atoi(optarg);
+            break;
+#else
+            app_error("-P needs the thread-safe driver, see make mdriver-mt");
+#endif
+        case 'H': /* Run the huge page comparison instead */
+            huge = 1;
+            break;
+        case 'B': /* Run the batch comparison instead */
+            batch = 1;
+            break;
+        case 'S': /* Run the sized free comparison instead */
+            sized = 1;
+            break;
+        case 'O': /* Run the free order comparison instead */
+            order = 1;
+            break;
+        case 'R': /* Run the region comparison instead */
+            region = 1;
+            break;
+        case 'p': /* Run the heap sampling comparison instead */
+            sample_bytes = atol(optarg);
+            if (sample_bytes < 1)
+                app_error("-p needs a sampling interval of at least 1 byte");
+            break;
+        case 'c': /* Print the allocator counters of each trace */
+            counters = 1;
+            break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
@@ -223,6 +365,9 @@ int main(int argc, char **argv)
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
+        num_realloc_tracefiles = sizeof(realloc_tracefiles) / sizeof(char *) - 1;
+        num_calloc_tracefiles = sizeof(calloc_tracefiles) / sizeof(char *) - 1;
+        num_memalign_tracefiles = sizeof(memalign_tracefiles) / sizeof(char *) - 1;
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
@@ -278,40 +423,46 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-        trace = read_trace(tracedir, tracefiles[i], i);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1) {
-          printf("Checking mm_malloc for correctness, ");
-          fflush(stdout);
-        }
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges, checks, 0);
-	if (mm_stats[i].valid) {
-          if (checks && (repeats > 0)) {
-            if (verbose > 1) {
-              printf("defensiveness, ");
-              fflush(stdout);
-            }
-            for (j = 0; j < repeats; j++)
-              (void)eval_mm_valid(trace, i, &d_ranges, checks, 1);
-          }
-          
-          if (verbose > 1) {
-            printf("efficiency, ");
-            fflush(stdout);
-          }
-          mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i].inst_util);
-          speed_params.trace = trace;
-          speed_params.ranges = ranges;
-          if (verbose > 1) {
-            printf("and performance.\n");
-            fflush(stdout);
-          }
-          mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    if (huge) {
+	bench_huge(tracedir, tracefiles, num_tracefiles);
+	exit(0);
+    }
+    if (batch) {
+	bench_batch(tracedir, tracefiles, num_tracefiles);
+	exit(0);
+    }
+    if (sized) {
+	bench_sized(tracedir, tracefiles, num_tracefiles);
+	exit(0);
+    }
+    if (sample_bytes > 0) {
+	bench_sample(tracedir, tracefiles, num_tracefiles);
+	exit(0);
+    }
+    if (order) {
+	bench_order(tracedir, tracefiles, num_tracefiles);
+	exit(0);
     }
+    if (region) {
+	bench_region(tracedir, tracefiles, num_tracefiles);
+	exit(0);
+    }
+
+#ifdef MM_THREADS
+    if (threads > 0) {
+	bench_threads(tracedir, tracefiles, num_tracefiles, threads);
+	exit(0);
+    }
+    if (pairs > 0) {
+	bench_pipes(tracedir, tracefiles, num_tracefiles, pairs);
+	exit(0);
+    }
+#endif
+
+    /* Evaluate student's mm malloc package using the K-best scheme */
+    for (i=0; i < num_tracefiles; i++)
+        mm_stats[i].valid = eval_mm_trace(tracedir, tracefiles[i], i, &mm_stats[i],
+                                          &ranges, &d_ranges, checks, repeats);
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -368,6 +519,72 @@ int main(int argc, char **argv)
 	printf("Terminated with %d errors\n", errors);
     }
 
+    /*
+     * Run the realloc traces on their own, so that they are reported
+     * separately and do not count toward the performance index
+     */
+    if (num_realloc_tracefiles > 0) {
+	realloc_stats = (stats_t *)calloc(num_realloc_tracefiles, sizeof(stats_t));
+	if (realloc_stats == NULL)
+	    unix_error("realloc_stats calloc in main failed");
+	if (verbose > 1)
+	    printf("\nTesting mm realloc\n");
+	for (i=0; i < num_realloc_tracefiles; i++)
+	    realloc_stats[i].valid = eval_mm_trace(tracedir, realloc_tracefiles[i], i,
+	                                           &realloc_stats[i], &ranges, &d_ranges,
+	                                           checks, repeats);
+	if (verbose) {
+	    printf("\nResults for mm realloc:\n");
+	    printreallocresults(num_realloc_tracefiles, realloc_tracefiles, realloc_stats);
+	    printf("\n");
+	}
+    }
+
+    /* The calloc traces are reported on their own in the same way */
+    if (num_calloc_tracefiles > 0) {
+	calloc_stats = (stats_t *)calloc(num_calloc_tracefiles, sizeof(stats_t));
+	if (calloc_stats == NULL)
+	    unix_error("calloc_stats calloc in main failed");
+	if (verbose > 1)
+	    printf("\nTesting mm calloc\n");
+	for (i=0; i < num_calloc_tracefiles; i++)
+	    calloc_stats[i].valid = eval_mm_trace(tracedir, calloc_tracefiles[i], i,
+	                                          &calloc_stats[i], &ranges, &d_ranges,
+	                                          checks, repeats);
+	if (verbose) {
+	    printf("\nResults for mm calloc:\n");
+	    printcallocresults(num_calloc_tracefiles, calloc_tracefiles, calloc_stats);
+	    printf("\n");
+	}
+    }
+
+    /* And so are the memalign traces */
+    if (num_memalign_tracefiles > 0) {
+	memalign_stats = (stats_t *)calloc(num_memalign_tracefiles, sizeof(stats_t));
+	if (memalign_stats == NULL)
+	    unix_error("memalign_stats calloc in main failed");
+	if (verbose > 1)
+	    printf("\nTesting mm memalign\n");
+	for (i=0; i < num_memalign_tracefiles; i++)
+	    memalign_stats[i].valid = eval_mm_trace(tracedir, memalign_tracefiles[i], i,
+	                                            &memalign_stats[i], &ranges, &d_ranges,
+	                                            checks, repeats);
+	if (verbose) {
+	    printf("\nResults for mm memalign:\n");
+	    printmemalignresults(num_memalign_tracefiles, memalign_tracefiles, memalign_stats);
+	    printf("\n");
+	}
+    }
+
+    if (checks) {
+        if (check_full > 1)
+            printf("Correctness runs took %.3f secs, checking the whole heap every %d mm_check calls\n",
+                   check_secs, check_full);
+        else
+            printf("Correctness runs took %.3f secs, checking the whole heap on every mm_check call\n",
+                   check_secs);
+    }
+
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
@@ -377,6 +594,69 @@ int main(int argc, char **argv)
 }
 
 
+/*
+ * eval_mm_trace - Read one tracefile and evaluate the mm package on it
+ *     for correctness, defensiveness, utilization and throughput,
+ *     filling in stats. Returns whether the trace ran correctly.
+ */
+static int eval_mm_trace(char *tracedir, char *tracefile, int tracenum, stats_t *stats,
+                         range_t **ranges, range_t **d_ranges, int checks, int repeats)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    struct timespec start, end;
+    int i, j;
+
+    trace = read_trace(tracedir, tracefile, tracenum);
+    stats->ops = trace->num_ops;
+    for (i = 0; i < trace->num_ops; i++) {
+      if (trace->ops[i].type == REALLOC)
+        stats->reallocs++;
+      else if (trace->ops[i].type == CALLOC)
+        stats->callocs++;
+      else if (trace->ops[i].type == MEMALIGN)
+        stats->memaligns++;
+    }
+    if (verbose > 1) {
+      printf("Checking mm_malloc for correctness, ");
+      fflush(stdout);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats->valid = eval_mm_valid(trace, tracenum, ranges, checks, 0);
+    if (stats->valid) {
+      if (checks && (repeats > 0)) {
+        if (verbose > 1) {
+          printf("defensiveness, ");
+          fflush(stdout);
+        }
+        for (j = 0; j < repeats; j++)
+          (void)eval_mm_valid(trace, tracenum, d_ranges, checks, 1);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      check_secs += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+      if (verbose > 1) {
+        printf("efficiency, ");
+        fflush(stdout);
+      }
+      stats->util = eval_mm_util(trace, tracenum, ranges, &stats->inst_util,
+                                 &stats->inplace);
+      speed_params.trace = trace;
+      speed_params.ranges = *ranges;
+      if (verbose > 1) {
+        printf("and performance.\n");
+        fflush(stdout);
+      }
+      stats->secs = fsecs(eval_mm_speed, &speed_params);
+      if (counters)
+        printcounters(tracefile, &util_counters);
+    }
+    free_trace(trace);
+
+    return stats->valid;
+}
+
+
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
@@ -386,10 +666,11 @@ int main(int argc, char **argv)
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     size bytes at addr lo, aligned to align bytes. After checking the
+ *     block for correctness, we create a range struct for this block and
+ *     add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, int size, int align,
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
@@ -399,10 +680,10 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be ALIGNMENT-byte aligned, or more */
+    if (!IS_ALIGNED(lo, align)) {
 	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
-		lo, ALIGNMENT);
+		lo, align);
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
@@ -494,7 +775,7 @@ static trace_t *read_trace(char *tracedir, char *filename, int fn_index)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, align;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -551,6 +832,21 @@ static trace_t *read_trace(char *tracedir, char *filename, int fn_index)
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
+	case 'c':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &align, &size);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].align = align;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
 	case 'f':
 	    fscanf(tracefile, "%ud", &index);
 	    trace->ops[op_index].type = FREE;
@@ -593,9 +889,9 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int checks, int chaos)
 {
-    int i, non_free_op = 0;
+    int i, j, non_free_op = 0;
     int index;
-    int size;
+    int size, oldsize, align;
     char *newp;
     char *oldp;
     char *p;
@@ -609,6 +905,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
 	return 0;
     }
 
+    /* Only a walk of the whole heap finds what chaos mangles */
+    if (!mm_setopt(MM_OPT_CHECK_FULL, chaos ? 1 : check_full))
+        app_error("mm_setopt failed in eval_mm_valid");
+
+    /* Freeing NULL must do nothing, as free(NULL) does */
+    mm_free(NULL);
+    if (checks && !chaos)
+        check(0, "free of NULL");
+
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
         if (checks) {
@@ -629,10 +934,24 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+
+	    /* Call the student's malloc, calloc or memalign */
+	    align = ALIGNMENT;
+	    if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else if (trace->ops[i].type == MEMALIGN) {
+		p = mm_memalign(trace->ops[i].align, size);
+		if (trace->ops[i].align > align)
+		    align = trace->ops[i].align;
+	    }
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) {
+		malloc_error(tracenum, i, trace->ops[i].type == CALLOC ? "mm_calloc failed." :
+			     trace->ops[i].type == MEMALIGN ? "mm_memalign failed." :
+			     "mm_malloc failed.");
 		return 0;
 	    }
             if (checks && !check(chaos, "alloc"))
@@ -644,8 +963,27 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (!chaos)
-              if (add_range(ranges, p, size, tracenum, i) == 0)
+              if (add_range(ranges, p, size, align, tracenum, i) == 0)
 		return 0;
+
+            /* A calloc'd block must read as zeros before we fill it */
+            if (!chaos && trace->ops[i].type == CALLOC) {
+              for (j = 0; j < size; j++) {
+                if (p[j] != 0) {
+                  malloc_error(tracenum, i, "mm_calloc did not zero the block");
+                  return 0;
+                }
+              }
+            }
+
+            /* The block must hold the request, and what mm_good_size
+               promised a plain one */
+            if (!chaos && (mm_usable_size(p) < (size_t)size
+                           || (trace->ops[i].type != MEMALIGN
+                               && mm_usable_size(p) < mm_good_size(size)))) {
+              malloc_error(tracenum, i, "mm_usable_size is less than the block got");
+              return 0;
+            }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
@@ -660,15 +998,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case REALLOC: /* mm_malloc + mm_free */
+        case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+            if (checks && !check_free(chaos, oldp))
+              return 0;
+	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
-            if (checks && !check(chaos, "alloc"))
+            if (checks && !check(chaos, "realloc"))
               return 0;
 
 	    /* Remove the old region from the range list */
@@ -677,17 +1017,28 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
 	    
 	    /* Check new block for correctness and add it to range list */
             if (!chaos) {
-              if (add_range(ranges, newp, size, tracenum, i) == 0)
+              if (add_range(ranges, newp, size, ALIGNMENT, tracenum, i) == 0)
 		return 0;
+
+              /* The old block was filled with the low byte of index,
+                 so the data that survived must still hold it */
+              oldsize = trace->block_sizes[index];
+              for (j = 0; j < ((size < oldsize) ? size : oldsize); j++) {
+                if (newp[j] != (char)(index & 0xFF)) {
+                  malloc_error(tracenum, i, "mm_realloc did not preserve the data from old block");
+                  return 0;
+                }
+              }
               memset(newp, index & 0xFF, size);
+
+              if (mm_usable_size(newp) < (size_t)size) {
+                malloc_error(tracenum, i, "mm_usable_size is less than the block got");
+                return 0;
+              }
             }
 
-            if (checks && !check_free(chaos, oldp))
-              return 0;
-            mm_free(oldp);
-            if (checks && !check(chaos, "free"))
-              return 0;
-            if (checks)
+            /* A block that moved must no longer be freeable */
+            if (checks && newp != oldp)
               check_post_free(chaos, oldp);
 
 	    /* Remember region */
@@ -731,7 +1082,8 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges, int che
  *   is always the high water mark of the heap. 
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio,
+                           int *inplace)
 {   
     int i;
     int index;
@@ -746,15 +1098,24 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
     /* initialize the heap and the mm malloc package */
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    *inplace = 0;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL)
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -767,16 +1128,16 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 
             break;
 
-	case REALLOC: /* mm_mealloc + mm_free */
+	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(newsize)) == NULL)
+	    if ((newp = mm_realloc(oldp, newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
-
-            mm_free(oldp);
+            if (newp == oldp)
+              (*inplace)++;
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -829,6 +1190,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
         // printf("%ld %ld %f\n", total_size, heap_size, ratio);
     }
 
+    mm_get_stats(&util_counters);
     mem_reset();
 
     ratio = accum_ratio_frac * pow(2, accum_ratio_exp / trace->num_ops);
@@ -867,13 +1229,28 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
-	case REALLOC: /* mm_malloc + mm_free */
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_malloc(newsize)) == NULL)
+            if ((newp = mm_realloc(oldp, newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
-            mm_free(oldp);
             trace->blocks[index] = newp;
             break;
 
@@ -890,6 +1267,904 @@ static void eval_mm_speed(void *ptr)
     mem_reset();
 }
 
+/*
+ * dtlb_open - Open a counter of this thread's dTLB read misses in user
+ *    mode, stopped; -1 where the system offers none.
+ */
+static int dtlb_open(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * bench_huge - Run each tracefile with plain and with huge page
+ *    mappings, and print the utilization, the time and the dTLB read
+ *    misses of each. Utilization is counted in 4K pages both ways.
+ *    mm only maps huge pages once a heap is large, so the spans it
+ *    mapped in them are printed too; a trace with none ran on 4K
+ *    pages both times.
+ */
+static void bench_huge(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    range_t *ranges = NULL;
+    double util[2], secs[2], inst_util;
+    uint64_t misses[2];
+    unsigned long huge_spans = 0;
+    int i, mode, inplace, fd, small = 0;
+
+    if (!mem_map_mode(MEM_MAP_HUGE))
+        app_error("-H needs madvise(MADV_HUGEPAGE)");
+    if ((fd = dtlb_open()) < 0)
+        printf("dTLB miss counter unavailable: %s\n", strerror(errno));
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_huge");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nHuge pages (4K mappings vs %zuK mappings):\n", HPAGE_SIZE / 1024);
+    printf("%20s%9s%9s%10s%10s%12s%12s%11s\n", "trace", "util 4K", "util 2M",
+           "secs 4K", "secs 2M", "dTLB 4K", "dTLB 2M", "huge spans");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+        for (mode = 0; mode < 2; mode++) {
+            mem_map_mode(mode ? MEM_MAP_HUGE : MEM_MAP_PAGES);
+            util[mode] = eval_mm_util(trace, i, &ranges, &inst_util, &inplace);
+            clear_ranges(&ranges);
+            huge_spans = util_counters.huge_spans;
+            secs[mode] = fsecs(eval_mm_speed, &speed_params);
+
+            /* one more run under the counter */
+            misses[mode] = 0;
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                eval_mm_speed(&speed_params);
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fd, &misses[mode], sizeof(misses[mode])) != sizeof(misses[mode]))
+                    unix_error("read error in bench_huge");
+            }
+        }
+        printf("%20s%8.0f%%%8.0f%%%10.6f%10.6f", tracefiles[i],
+               util[0] * 100.0, util[1] * 100.0, secs[0], secs[1]);
+        if (fd >= 0)
+            printf("%12" PRIu64 "%12" PRIu64, misses[0], misses[1]);
+        else
+            printf("%12s%12s", "-", "-");
+        printf("%11lu\n", huge_spans);
+        if (huge_spans == 0)
+            small++;
+        free_trace(trace);
+    }
+    free(traces);
+    if (small > 0)
+        printf("%d trace%s never grew a heap large enough for huge pages and ran on 4K pages both times.\n",
+               small, small > 1 ? "s" : "");
+
+    mem_map_mode(MEM_MAP_PAGES);
+    if (fd >= 0)
+        close(fd);
+}
+
+/*
+ * replay_batched - Run a trace on the mm package, making each run of
+ *    consecutive allocs of one size a single mm_malloc_batch call and
+ *    each run of consecutive frees a single mm_free_batch call, with
+ *    a NULL after the blocks that it must skip. The other requests are
+ *    made one at a time. Returns the number of
+ *    calls made.
+ */
+static int replay_batched(trace_t *trace, void **batch)
+{
+    int i, j, k, size, calls = 0;
+    char *p;
+
+    for (i = 0; i < trace->num_ops; i = j, calls++) {
+        j = i + 1;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc_batch */
+            while (j < trace->num_ops && trace->ops[j].type == ALLOC
+                   && trace->ops[j].size == size)
+                j++;
+            if (mm_malloc_batch(size, j - i, batch) != (size_t)(j - i))
+                app_error("mm_malloc_batch error in replay_batched");
+            for (k = i; k < j; k++)
+                trace->blocks[trace->ops[k].index] = batch[k - i];
+            break;
+
+        case FREE: /* mm_free_batch */
+            while (j < trace->num_ops && trace->ops[j].type == FREE)
+                j++;
+            for (k = i; k < j; k++)
+                batch[k - i] = trace->blocks[trace->ops[k].index];
+            batch[j - i] = NULL;
+            mm_free_batch(batch, j - i + 1);
+            break;
+
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in replay_batched");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in replay_batched");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[trace->ops[i].index], size)) == NULL)
+                app_error("mm_realloc error in replay_batched");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        default:
+            app_error("Nonexistent request type in replay_batched");
+        }
+    }
+    return calls;
+}
+
+/*
+ * eval_mm_batch_speed - eval_mm_speed with the requests batched by
+ *    replay_batched, for fcyc() to time.
+ */
+static void eval_mm_batch_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_batch_speed");
+    replay_batched(params->trace, params->batch);
+    mem_reset();
+}
+
+/*
+ * bench_batch - Run each tracefile with single and with batched
+ *    calls, and print how many calls the batched run makes and the
+ *    best time of each way. The batched run is checked with mm_check
+ *    once before it is timed.
+ */
+static void bench_batch(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    double secs[2];
+    int i, calls;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_batch");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nBatched calls (runs of same-size allocs and of frees):\n");
+    printf("%20s%8s%8s%10s%11s%8s\n", "trace", "ops", "calls",
+           "secs one", "secs batch", "speedup");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+        if ((speed_params.batch = (void **)malloc((trace->num_ops + 1) * sizeof(void *))) == NULL)
+            unix_error("malloc error in bench_batch");
+
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_batch");
+        calls = replay_batched(trace, speed_params.batch);
+        if (!mm_check())
+            app_error("mm_check failed after replay_batched");
+        mem_reset();
+
+        best_secs(eval_mm_speed, eval_mm_batch_speed, &speed_params, secs);
+        printf("%20s%8d%8d%10.6f%11.6f%8.2f\n", tracefiles[i], trace->num_ops,
+               calls, secs[0], secs[1], secs[0] / secs[1]);
+        free(speed_params.batch);
+        free_trace(trace);
+    }
+    free(traces);
+}
+
+/*
+ * replay_sized - Run a trace on the mm package, freeing each block
+ *    with mm_free_sized and the size it was last requested with,
+ *    memalign blocks included, which mm_free_sized has to tell apart
+ *    from slab slots of the same size.
+ */
+static void replay_sized(trace_t *trace)
+{
+    int i, index, size;
+    char *p;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(size)) == NULL)
+                app_error("mm_malloc error in replay_sized");
+            break;
+
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in replay_sized");
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in replay_sized");
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+                app_error("mm_realloc error in replay_sized");
+            break;
+
+        case FREE: /* mm_free_sized */
+            mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
+            continue;
+
+        default:
+            app_error("Nonexistent request type in replay_sized");
+        }
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+    }
+}
+
+/*
+ * eval_mm_sized_speed - eval_mm_speed with the blocks freed by
+ *    replay_sized, for fcyc() to time.
+ */
+static void eval_mm_sized_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_sized_speed");
+    replay_sized(params->trace);
+    mem_reset();
+}
+
+/*
+ * bench_sized - Run each tracefile with plain and with sized frees,
+ *    and print the best time of each way. The sized run is checked
+ *    with mm_check once before it is timed.
+ */
+static void bench_sized(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    double secs[2];
+    int i;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_sized");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nSized frees (mm_free_sized with the requested size):\n");
+    printf("%20s%8s%10s%11s%8s\n", "trace", "ops", "secs free", "secs sized", "speedup");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_sized");
+        replay_sized(trace);
+        if (!mm_check())
+            app_error("mm_check failed after replay_sized");
+        mem_reset();
+
+        best_secs(eval_mm_speed, eval_mm_sized_speed, &speed_params, secs);
+        printf("%20s%8d%10.6f%11.6f%8.2f\n", tracefiles[i], trace->num_ops,
+               secs[0], secs[1], secs[0] / secs[1]);
+        free_trace(trace);
+    }
+    free(traces);
+}
+
+/*
+ * replay_sampled - Run the first num_ops requests of a trace on the mm
+ *    package the way eval_mm_speed does, leaving the heap as it is.
+ */
+static void replay_sampled(trace_t *trace, int num_ops)
+{
+    int i, index, size;
+    char *p;
+
+    for (i = 0; i < num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(size)) == NULL)
+                app_error("mm_malloc error in replay_sampled");
+            break;
+
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in replay_sampled");
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in replay_sampled");
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+                app_error("mm_realloc error in replay_sampled");
+            break;
+
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[index]);
+            continue;
+
+        default:
+            app_error("Nonexistent request type in replay_sampled");
+        }
+        trace->blocks[index] = p;
+    }
+}
+
+/*
+ * eval_mm_sampled_speed - eval_mm_speed with a heap profile sampled
+ *    every sample_bytes bytes, for fcyc() to time.
+ */
+static void eval_mm_sampled_speed(void *ptr)
+{
+    if (!mm_setopt(MM_OPT_SAMPLE_BYTES, sample_bytes))
+        app_error("mm_setopt failed in eval_mm_sampled_speed");
+    eval_mm_speed(ptr);
+    mm_setopt(MM_OPT_SAMPLE_BYTES, 0);
+}
+
+/*
+ * bench_sample - Run each tracefile without and with heap sampling,
+ *    and print the best time of each way. The sampled run is first
+ *    replayed up to the middle of the trace, checked with mm_check and
+ *    its heap profile dumped, to count the live blocks it sampled; that
+ *    also gets backtrace() loaded before anything is timed. Next to
+ *    those goes the number of samples a whole run takes on average,
+ *    the bytes it allocates over the sampling interval, which is what
+ *    the slowdown pays for.
+ */
+static void bench_sample(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    double secs[2], bytes;
+    size_t samples;
+    FILE *f;
+    int i, j;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_sample");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nHeap sampling (a sample every %ld bytes on average):\n", sample_bytes);
+    printf("%20s%8s%10s%13s%9s%9s%9s\n", "trace", "ops", "secs off", "secs sampled",
+           "slowdown", "live", "per run");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_sample");
+        if (!mm_setopt(MM_OPT_SAMPLE_BYTES, sample_bytes))
+            app_error("mm_setopt failed in bench_sample");
+        replay_sampled(trace, trace->num_ops / 2);
+        if (!mm_check())
+            app_error("mm_check failed after replay_sampled");
+        if ((f = tmpfile()) == NULL)
+            unix_error("tmpfile failed in bench_sample");
+        if (!mm_heap_profile_dump(f))
+            app_error("mm_heap_profile_dump failed in bench_sample");
+        rewind(f);
+        if (fscanf(f, "heap profile: %zu:", &samples) != 1)
+            app_error("bad heap profile in bench_sample");
+        fclose(f);
+        mm_setopt(MM_OPT_SAMPLE_BYTES, 0);
+        mem_reset();
+
+        bytes = 0;
+        for (j = 0; j < trace->num_ops; j++)
+            if (trace->ops[j].type != FREE)
+                bytes += trace->ops[j].size;
+
+        best_secs(eval_mm_speed, eval_mm_sampled_speed, &speed_params, secs);
+        printf("%20s%8d%10.6f%13.6f%9.2f%9zu%9.0f\n", tracefiles[i], trace->num_ops,
+               secs[0], secs[1], secs[1] / secs[0], samples, bytes / sample_bytes);
+        free_trace(trace);
+    }
+    free(traces);
+}
+
+/*
+ * eval_mm_ordered_speed - eval_mm_speed with address-ordered free bins,
+ *    for fcyc() to time.
+ */
+static void eval_mm_ordered_speed(void *ptr)
+{
+    if (!mm_setopt(MM_OPT_ADDRESS_ORDER, 1))
+        app_error("mm_setopt failed in eval_mm_ordered_speed");
+    eval_mm_speed(ptr);
+    mm_setopt(MM_OPT_ADDRESS_ORDER, 0);
+}
+
+/*
+ * bench_order - Run each tracefile with the small free bins in LIFO
+ *    and in address order, and print the utilization, the average
+ *    instantaneous utilization, the chunks emptied and released, and
+ *    the best time of each.
+ */
+static void bench_order(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    range_t *ranges = NULL;
+    double util[2], inst_util[2], secs[2];
+    unsigned long releases[2];
+    int i, mode, inplace;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_order");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nFree order (LIFO bins vs address-ordered bins):\n");
+    printf("%20s%7s%7s%9s%9s%7s%7s%10s%10s\n", "trace", "util", "util", "util_i", "util_i",
+           "rels", "rels", "secs", "secs");
+    printf("%20s%7s%7s%9s%9s%7s%7s%10s%10s\n", "", "LIFO", "addr", "LIFO", "addr",
+           "LIFO", "addr", "LIFO", "addr");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+        for (mode = 0; mode < 2; mode++) {
+            if (!mm_setopt(MM_OPT_ADDRESS_ORDER, mode))
+                app_error("mm_setopt failed in bench_order");
+            util[mode] = eval_mm_util(trace, i, &ranges, &inst_util[mode], &inplace);
+            releases[mode] = util_counters.chunk_releases;
+            clear_ranges(&ranges);
+        }
+        mm_setopt(MM_OPT_ADDRESS_ORDER, 0);
+
+        best_secs(eval_mm_speed, eval_mm_ordered_speed, &speed_params, secs);
+        printf("%20s%6.0f%%%6.0f%%%8.0f%%%8.0f%%%7lu%7lu%10.6f%10.6f\n", tracefiles[i],
+               util[0] * 100.0, util[1] * 100.0, inst_util[0] * 100.0, inst_util[1] * 100.0,
+               releases[0], releases[1], secs[0], secs[1]);
+        free_trace(trace);
+    }
+    free(traces);
+}
+
+/*
+ * replay_region - Run a trace's requests on region r: every block comes
+ *    from mm_region_malloc, aligned ones with their alignment added, a
+ *    realloc takes a new block and copies the old payload over, and the
+ *    frees are left to the region's destroy.
+ */
+static void replay_region(trace_t *trace, mm_region_t *r)
+{
+    int i, index, size, align, oldsize;
+    char *p;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_region_malloc(r, size)) == NULL)
+                app_error("mm_region_malloc error in replay_region");
+            break;
+
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_region_malloc(r, size)) == NULL)
+                app_error("mm_region_malloc error in replay_region");
+            memset(p, 0, size);
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            align = trace->ops[i].align;
+            if ((p = mm_region_malloc(r, size + align - 1)) == NULL)
+                app_error("mm_region_malloc error in replay_region");
+            p = (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_region_malloc(r, size)) == NULL)
+                app_error("mm_region_malloc error in replay_region");
+            oldsize = trace->block_sizes[index];
+            memcpy(p, trace->blocks[index], oldsize < size ? oldsize : size);
+            break;
+
+        case FREE: /* mm_free */
+            continue;
+
+        default:
+            app_error("Nonexistent request type in replay_region");
+        }
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+    }
+}
+
+/*
+ * eval_mm_region_speed - Run a trace on a region and destroy it, for
+ *    fcyc() to time against eval_mm_speed.
+ */
+static void eval_mm_region_speed(void *ptr)
+{
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    mm_region_t *r;
+
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_region_speed");
+    if ((r = mm_region_create()) == NULL)
+        app_error("mm_region_create failed in eval_mm_region_speed");
+    replay_region(trace, r);
+    mm_region_destroy(r);
+    mem_reset();
+}
+
+/*
+ * bench_region - Run each tracefile with every block freed on its own
+ *    and with the blocks taken from a region that is destroyed at the
+ *    end, and print the best time of each way. The region run is first
+ *    made once to measure the heap the region grows to, and to check
+ *    that destroying it gives all of that back.
+ */
+static void bench_region(char *tracedir, char **tracefiles, int num_tracefiles)
+{
+    trace_t **traces, *trace;
+    speed_t speed_params;
+    mm_region_t *r;
+    double secs[2];
+    size_t base, peak;
+    int i;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_region");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+
+    printf("\nRegions (single frees vs one mm_region_destroy):\n");
+    printf("%20s%8s%10s%12s%8s%11s\n", "trace", "ops", "secs free", "secs region",
+           "speedup", "region KB");
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = traces[i];
+        speed_params.trace = trace;
+
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_region");
+        base = mem_heapsize();
+        if ((r = mm_region_create()) == NULL)
+            app_error("mm_region_create failed in bench_region");
+        replay_region(trace, r);
+        peak = mem_heapsize() - base;
+        mm_region_destroy(r);
+        if (mem_heapsize() != base || !mm_check())
+            app_error("mm_region_destroy left the heap changed");
+        mem_reset();
+
+        best_secs(eval_mm_speed, eval_mm_region_speed, &speed_params, secs);
+        printf("%20s%8d%10.6f%12.6f%8.2f%11zu\n", tracefiles[i], trace->num_ops,
+               secs[0], secs[1], secs[0] / secs[1], peak / 1024);
+        free_trace(trace);
+    }
+    free(traces);
+}
+
+/*
+ * best_secs - Time f0 and f1 on argp BEST_TRIALS times each, taking
+ *    turns so that both see the same machine, and leave the best time
+ *    of each in secs[0] and secs[1].
+ */
+static void best_secs(fsecs_test_funct f0, fsecs_test_funct f1, void *argp,
+                      double *secs)
+{
+    double s;
+    int t;
+
+    for (t = 0; t < BEST_TRIALS; t++) {
+        s = fsecs(f0, argp);
+        if (t == 0 || s < secs[0])
+            secs[0] = s;
+        s = fsecs(f1, argp);
+        if (t == 0 || s < secs[1])
+            secs[1] = s;
+    }
+}
+
+#ifdef MM_THREADS
+/*
+ * bench_thread - One thread of the scaling benchmark: replay every
+ *    tracefile BENCH_ROUNDS times, keeping the blocks in the thread's
+ *    own array.
+ */
+static void *bench_thread(void *ptr)
+{
+    bench_t *bench = (bench_t *)ptr;
+    trace_t *trace;
+    int i, t, round, index;
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+        for (t = 0; t < bench->num_traces; t++) {
+            trace = bench->traces[t];
+            for (i = 0; i < trace->num_ops; i++) {
+                index = trace->ops[i].index;
+                switch (trace->ops[i].type) {
+                case ALLOC:
+                    bench->blocks[index] = mm_malloc(trace->ops[i].size);
+                    if (bench->blocks[index] == NULL)
+                        app_error("mm_malloc error in bench_thread");
+                    break;
+                case CALLOC:
+                    bench->blocks[index] = mm_calloc(1, trace->ops[i].size);
+                    if (bench->blocks[index] == NULL)
+                        app_error("mm_calloc error in bench_thread");
+                    break;
+                case MEMALIGN:
+                    bench->blocks[index] = mm_memalign(trace->ops[i].align,
+                                                       trace->ops[i].size);
+                    if (bench->blocks[index] == NULL)
+                        app_error("mm_memalign error in bench_thread");
+                    break;
+                case REALLOC:
+                    bench->blocks[index] = mm_realloc(bench->blocks[index],
+                                                      trace->ops[i].size);
+                    if (bench->blocks[index] == NULL)
+                        app_error("mm_realloc error in bench_thread");
+                    break;
+                case FREE:
+                    mm_free(bench->blocks[index]);
+                    break;
+                }
+            }
+        }
+
+    return NULL;
+}
+
+/*
+ * bench_threads - Run the tracefiles in 1, 2, ... max_threads threads
+ *    at once against one heap, and print the combined throughput and
+ *    the speedup over a single thread for each thread count.
+ */
+static void bench_threads(char *tracedir, char **tracefiles, int num_tracefiles,
+                          int max_threads)
+{
+    trace_t **traces;
+    bench_t *benches;
+    pthread_t *tids;
+    struct timespec start, end;
+    mm_arena_stats_t *arena_stats;
+    double ops = 0, secs, kops, base = 0;
+    int i, n, max_ids = 0, num_arenas = mm_arena_count();
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc error in bench_threads");
+    for (i = 0; i < num_tracefiles; i++) {
+        traces[i] = read_trace(tracedir, tracefiles[i], i);
+        ops += traces[i]->num_ops;
+        if (traces[i]->num_ids > max_ids)
+            max_ids = traces[i]->num_ids;
+    }
+    ops *= BENCH_ROUNDS;
+
+    benches = (bench_t *)calloc(max_threads, sizeof(bench_t));
+    tids = (pthread_t *)calloc(max_threads, sizeof(pthread_t));
+    arena_stats = (mm_arena_stats_t *)calloc(num_arenas, sizeof(mm_arena_stats_t));
+    if (benches == NULL || tids == NULL || arena_stats == NULL)
+        unix_error("calloc error in bench_threads");
+    for (i = 0; i < max_threads; i++) {
+        benches[i].traces = traces;
+        benches[i].num_traces = num_tracefiles;
+        if ((benches[i].blocks = (char **)malloc(max_ids * sizeof(char *))) == NULL)
+            unix_error("malloc error in bench_threads");
+    }
+
+    printf("\nThread scaling (%d rounds of the tracefiles per thread):\n", BENCH_ROUNDS);
+    printf("%7s%10s%8s\n", "threads", "Kops", "speedup");
+    for (n = 1; n <= max_threads; n++) {
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_threads");
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n; i++)
+            if (pthread_create(&tids[i], NULL, bench_thread, &benches[i]) != 0)
+                app_error("pthread_create failed in bench_threads");
+        for (i = 0; i < n; i++)
+            pthread_join(tids[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (!mm_check())
+            app_error("mm_check failed after bench_threads");
+        for (i = 0; i < num_arenas; i++)
+            mm_arena_stats(i, &arena_stats[i]);
+        mem_reset();
+
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        kops = n * ops / 1e3 / secs;
+        if (n == 1)
+            base = kops;
+        printf("%7d%10.0f%8.2f\n", n, kops, kops / base);
+    }
+
+    /* The arenas as the run with the most threads left them */
+    printf("\nArenas after %d threads:\n", max_threads);
+    printf("%5s%10s%10s%10s%11s%8s%8s%9s\n", "arena", "peak KB", "locks", "contended", "contended%",
+           "reused", "mapped", "released");
+    for (i = 0; i < num_arenas; i++)
+        printf("%5d%10.0f%10lu%10lu%10.2f%%%8lu%8lu%9lu\n", i,
+               arena_stats[i].heap_peak / 1024.0,
+               arena_stats[i].locks,
+               arena_stats[i].contended,
+               arena_stats[i].locks ? 100.0 * arena_stats[i].contended / arena_stats[i].locks : 0.0,
+               arena_stats[i].retain_hits,
+               arena_stats[i].retain_misses,
+               arena_stats[i].retain_releases);
+
+    for (i = 0; i < max_threads; i++)
+        free(benches[i].blocks);
+    free(benches);
+    free(tids);
+    free(arena_stats);
+    for (i = 0; i < num_tracefiles; i++)
+        free_trace(traces[i]);
+    free(traces);
+}
+
+/*
+ * pipe_producer - Allocate every size of the tracefiles BENCH_ROUNDS
+ *    times and pass the blocks to the consumer, then a NULL to stop it.
+ */
+static void *pipe_producer(void *ptr)
+{
+    pipe_t *pipe = (pipe_t *)ptr;
+    unsigned long tail = 0;
+    char *p;
+    int i, round;
+
+    for (round = 0; round <= BENCH_ROUNDS; round++)
+        for (i = 0; i < pipe->num_sizes; i++) {
+            p = NULL;
+            if (round < BENCH_ROUNDS && (p = mm_malloc(pipe->sizes[i])) == NULL)
+                app_error("mm_malloc error in pipe_producer");
+            while (tail - __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) == PIPE_SLOTS)
+                sched_yield();
+            pipe->slots[tail % PIPE_SLOTS] = p;
+            __atomic_store_n(&pipe->tail, ++tail, __ATOMIC_RELEASE);
+            if (p == NULL)
+                return NULL;
+        }
+    return NULL;
+}
+
+/*
+ * pipe_consumer - Free the producer's blocks until it sends a NULL.
+ */
+static void *pipe_consumer(void *ptr)
+{
+    pipe_t *pipe = (pipe_t *)ptr;
+    unsigned long head = 0;
+    char *p;
+
+    for (;;) {
+        while (__atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) == head)
+            sched_yield();
+        p = pipe->slots[head % PIPE_SLOTS];
+        __atomic_store_n(&pipe->head, ++head, __ATOMIC_RELEASE);
+        if (p == NULL)
+            return NULL;
+        mm_free(p);
+    }
+}
+
+/*
+ * bench_pipes - Run pairs of threads where one allocates and the other
+ *    frees, once with remote frees off and once with them on, and print
+ *    the throughput and how often the arena locks were busy.
+ */
+static void bench_pipes(char *tracedir, char **tracefiles, int num_tracefiles,
+                        int pairs)
+{
+    trace_t *trace;
+    pipe_t *pipes;
+    pthread_t *tids;
+    struct timespec start, end;
+    mm_arena_stats_t arena_stats;
+    size_t *sizes = NULL;
+    double secs;
+    unsigned long locks, contended, remote_frees;
+    int i, t, num_sizes = 0, max_sizes = 0, remote;
+
+    for (t = 0; t < num_tracefiles; t++) {
+        trace = read_trace(tracedir, tracefiles[t], t);
+        for (i = 0; i < trace->num_ops; i++) {
+            if (trace->ops[i].type != ALLOC && trace->ops[i].type != CALLOC)
+                continue;
+            if (num_sizes == max_sizes) {
+                max_sizes = max_sizes ? 2 * max_sizes : 1024;
+                if ((sizes = (size_t *)realloc(sizes, max_sizes * sizeof(size_t))) == NULL)
+                    unix_error("realloc error in bench_pipes");
+            }
+            sizes[num_sizes++] = trace->ops[i].size;
+        }
+        free_trace(trace);
+    }
+
+    pipes = (pipe_t *)calloc(pairs, sizeof(pipe_t));
+    tids = (pthread_t *)calloc(2 * pairs, sizeof(pthread_t));
+    if (pipes == NULL || tids == NULL)
+        unix_error("calloc error in bench_pipes");
+
+    printf("\nRemote frees (%d pairs, %d rounds of the tracefile sizes each):\n",
+           pairs, BENCH_ROUNDS);
+    printf("%7s%10s%11s%13s\n", "remote", "Kops", "contended%", "remote frees");
+    for (remote = 0; remote <= 1; remote++) {
+        if (mm_init() < 0)
+            app_error("mm_init failed in bench_pipes");
+        if (!mm_setopt(MM_OPT_REMOTE_FREE, remote))
+            app_error("mm_setopt failed in bench_pipes");
+        for (i = 0; i < pairs; i++) {
+            pipes[i].sizes = sizes;
+            pipes[i].num_sizes = num_sizes;
+            pipes[i].head = pipes[i].tail = 0;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < pairs; i++)
+            if (pthread_create(&tids[2*i], NULL, pipe_producer, &pipes[i]) != 0 ||
+                pthread_create(&tids[2*i+1], NULL, pipe_consumer, &pipes[i]) != 0)
+                app_error("pthread_create failed in bench_pipes");
+        for (i = 0; i < 2 * pairs; i++)
+            pthread_join(tids[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (!mm_check())
+            app_error("mm_check failed after bench_pipes");
+        locks = contended = remote_frees = 0;
+        for (i = 0; i < mm_arena_count(); i++) {
+            mm_arena_stats(i, &arena_stats);
+            locks += arena_stats.locks;
+            contended += arena_stats.contended;
+            remote_frees += arena_stats.remote_frees;
+        }
+        mem_reset();
+
+        /* Each block is one malloc and one free */
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%7s%10.0f%10.2f%%%13lu\n", remote ? "on" : "off",
+               2.0 * pairs * num_sizes * BENCH_ROUNDS / 1e3 / secs,
+               locks ? 100.0 * contended / locks : 0.0, remote_frees);
+    }
+
+    free(pipes);
+    free(tids);
+    free(sizes);
+}
+#endif
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -912,6 +2187,23 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if ((errno = posix_memalign((void **)&p, trace->ops[i].align,
+					trace->ops[i].size)) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
@@ -956,6 +2248,22 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((errno = posix_memalign((void **)&p, trace->ops[i].align, size)) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -990,10 +2298,8 @@ static int check(int chaos, const char *what)
     }
   } else {
     if (!mm_check()) {
-      if (!strcmp(what, "alloc"))
-        app_error("mm_check failed after alloc");
-      else
-        app_error("mm_check failed after free");
+      sprintf(msg, "mm_check failed after %s", what);
+      app_error(msg);
     }
   }
 
@@ -1128,6 +2434,91 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printreallocresults - prints a summary for the realloc traces, with
+ *     the share of reallocs that were resized in place
+ */
+static void printreallocresults(int n, char **tracefiles, stats_t *stats)
+{
+    int i;
+
+    printf("%-20s%6s%6s%7s%9s%8s%10s%6s\n",
+	   "trace", "valid", "util", "util_i", "reallocs", "inplace", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%-20s%6s%5.0f%%%6.0f%%%9d%7.0f%%%10.6f%6.0f\n",
+		   tracefiles[i],
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].inst_util*100.0,
+		   stats[i].reallocs,
+		   stats[i].reallocs ? (100.0*stats[i].inplace)/stats[i].reallocs : 0.0,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	}
+	else {
+	    printf("%-20s%6s%6s%7s%9s%8s%10s%6s\n",
+		   tracefiles[i], "no", "-", "-", "-", "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printcallocresults - prints a summary for the calloc traces, with
+ *     the number of callocs in each
+ */
+static void printcallocresults(int n, char **tracefiles, stats_t *stats)
+{
+    int i;
+
+    printf("%-20s%6s%6s%7s%9s%10s%6s\n",
+	   "trace", "valid", "util", "util_i", "callocs", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%-20s%6s%5.0f%%%6.0f%%%9d%10.6f%6.0f\n",
+		   tracefiles[i],
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].inst_util*100.0,
+		   stats[i].callocs,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	}
+	else {
+	    printf("%-20s%6s%6s%7s%9s%10s%6s\n",
+		   tracefiles[i], "no", "-", "-", "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printmemalignresults - prints a summary for the memalign traces,
+ *     with the number of memaligns in each
+ */
+static void printmemalignresults(int n, char **tracefiles, stats_t *stats)
+{
+    int i;
+
+    printf("%-20s%6s%6s%7s%10s%10s%6s\n",
+	   "trace", "valid", "util", "util_i", "memaligns", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%-20s%6s%5.0f%%%6.0f%%%10d%10.6f%6.0f\n",
+		   tracefiles[i],
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].inst_util*100.0,
+		   stats[i].memaligns,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	}
+	else {
+	    printf("%-20s%6s%6s%7s%10s%10s%6s\n",
+		   tracefiles[i], "no", "-", "-", "-", "-", "-");
+	}
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1155,14 +2546,49 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * printcounters - Print the mm_get_stats counters of a trace's
+ *     utilization run: the blocks allocated and freed per size class,
+ *     the work done to place them, and the memory mapped and cached.
+ */
+static void printcounters(char *tracefile, mm_stats_t *stats)
+{
+    char name[16];
+    int c;
+
+    printf("Counters for %s:\n", tracefile);
+    printf("%8s%10s%10s%10s\n", "class", "size", "mallocs", "frees");
+    for (c = 0; c < stats->classes; c++) {
+        if (stats->mallocs[c] == 0 && stats->frees[c] == 0)
+            continue;
+        if (c == stats->classes - 2)
+            strcpy(name, "chunk");
+        else if (c == stats->classes - 1)
+            strcpy(name, "large");
+        else
+            sprintf(name, "%d", c);
+        if (stats->class_size[c] != 0)
+            printf("%8s%10zu%10lu%10lu\n", name, stats->class_size[c],
+                   stats->mallocs[c], stats->frees[c]);
+        else
+            printf("%8s%10s%10lu%10lu\n", name, "-", stats->mallocs[c], stats->frees[c]);
+    }
+    printf("splits %lu, coalesces %lu, extends %lu, releases %lu, searches %lu (%.2f steps each)\n",
+           stats->splits, stats->coalesces, stats->extends, stats->chunk_releases, stats->searches,
+           stats->searches ? (double)stats->search_steps / stats->searches : 0.0);
+    printf("mapped %zu KB, unmapped %zu KB, %zu KB left in caches\n\n",
+           stats->mapped_bytes / 1024, stats->unmapped_bytes / 1024, stats->cached_bytes / 1024);
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-nhvVal] [-f <file>] [-t <dir>] [-s <seed>] [-r <reps>]\n");
+    fprintf(stderr, "Usage: mdriver [-nhvValHBSORc] [-f <file>] [-t <dir>] [-s <seed>] [-r <reps>] [-i <n>] [-T <n>] [-P <n>] [-p <bytes>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-n         Skip mm_check and mm_can_free correctness.\n");
+    fprintf(stderr, "\t-i <n>     Check only what changed, walking the whole heap every <n>th mm_check.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
@@ -1171,4 +2597,13 @@ static void usage(void)
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-q         Quiet: not per-trace performance breakdowns.\n");
+    fprintf(stderr, "\t-H         Compare 4K and huge page mappings per trace.\n");
+    fprintf(stderr, "\t-B         Compare single and batched malloc and free calls per trace.\n");
+    fprintf(stderr, "\t-S         Compare plain and sized frees per trace.\n");
+    fprintf(stderr, "\t-O         Compare LIFO and address-ordered free bins per trace.\n");
+    fprintf(stderr, "\t-R         Compare single frees and a region destroyed at once per trace.\n");
+    fprintf(stderr, "\t-c         Print the allocator's counters per trace.\n");
+    fprintf(stderr, "\t-p <bytes> Compare runs without and with heap sampling every <bytes> per trace.\n");
+    fprintf(stderr, "\t-T <n>     Measure throughput with 1 to <n> threads (mdriver-mt only).\n");
+    fprintf(stderr, "\t-P <n>     Measure <n> pairs of allocating and freeing threads (mdriver-mt only).\n");
 }
@@ -16,7 +16,9 @@
 /* private variables */
 static int activity_counter = 0; /* to simulate other processes */
 
-static int page_count;
+static int page_count; /* committed pages */
+static int decommit_advice = MADV_DONTNEED;
+static size_t map_unit = APAGE_SIZE; /* HPAGE_SIZE in huge page mode */
 
 /* 
  * mem_init - initialize the memory system model
@@ -58,12 +60,40 @@ size_t mem_pagesize()
   return APAGE_SIZE;
 }
 
+/*
+ * mem_heapsize() - bytes of mapped pages that are committed
+ */
 size_t mem_heapsize(void)
 {
   return APAGE_SIZE * page_count;
 }
 
 
+/*
+ * map_huge - map sz bytes aligned to a huge page and ask for huge
+ *   pages behind them; the alignment comes from mapping one huge page
+ *   more and unmapping what lies outside
+ */
+static void *map_huge(size_t sz)
+{
+  char *p, *start;
+
+  p = mmap(0, sz + map_unit, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (p == MAP_FAILED)
+    return p;
+
+  start = (char *)(((uintptr_t)p + map_unit - 1) & ~(uintptr_t)(map_unit - 1));
+  if (start > p)
+    munmap(p, start - p);
+  munmap(start + sz, p + map_unit - start);
+
+#ifdef MADV_HUGEPAGE
+  /* only advice: without transparent huge pages this is a plain mapping */
+  (void)madvise(start, sz, MADV_HUGEPAGE);
+#endif
+  return start;
+}
+
 void *mem_map(size_t sz)
 {
   void *p;
@@ -82,7 +112,10 @@ void *mem_map(size_t sz)
     mmap(0, APAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
   }
 
-  p = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (map_unit != APAGE_SIZE && sz % map_unit == 0)
+    p = map_huge(sz);
+  else
+    p = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
   if (p == MAP_FAILED) {
     fprintf(stderr, "mmap failed: %s (%d)\n",
             strerror(errno), errno);
@@ -134,8 +167,9 @@ void mem_unmap(void *p, size_t sz)
   (void)check_mapped(p, sz, 1);
   
   for (i = 0; i < sz; i += APAGE_SIZE) {
+    if (pagemap_is_committed(p + i))
+      --page_count;
     pagemap_modify(p + i, 0);
-    --page_count;
   }
 
   if (munmap(p, sz) < 0) {
@@ -149,3 +183,130 @@ int mem_is_mapped(void *p, size_t sz)
 {
   return check_mapped(p, sz, 0);
 }
+
+/*
+ * mem_decommit - give the memory behind mapped pages back to the
+ *   system while keeping the address range; their contents are lost.
+ *   Returns the bytes that were committed until now.
+ */
+size_t mem_decommit(void *p, size_t sz)
+{
+  size_t i, bytes = 0;
+
+  (void)check_mapped(p, sz, 1);
+
+  if (madvise(p, sz, decommit_advice) < 0) {
+    fprintf(stderr, "madvise failed: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+
+  for (i = 0; i < sz; i += APAGE_SIZE) {
+    if (pagemap_set_committed(p + i, 0)) {
+      --page_count;
+      bytes += APAGE_SIZE;
+    }
+  }
+  return bytes;
+}
+
+/*
+ * mem_recommit - make decommitted pages usable again; they read as
+ *   zeros or as their old contents. Returns the bytes that were
+ *   decommitted until now.
+ */
+size_t mem_recommit(void *p, size_t sz)
+{
+  size_t i, bytes = 0;
+
+  (void)check_mapped(p, sz, 1);
+
+  for (i = 0; i < sz; i += APAGE_SIZE) {
+    if (pagemap_set_committed(p + i, 1)) {
+      page_count++;
+      bytes += APAGE_SIZE;
+    }
+  }
+  return bytes;
+}
+
+/*
+ * mem_zero - swap the committed pages of a range for zero-filled ones,
+ *   which the system supplies as they are next touched; they stay
+ *   committed
+ */
+void mem_zero(void *p, size_t sz)
+{
+  (void)check_mapped(p, sz, 1);
+
+  if (madvise(p, sz, MADV_DONTNEED) < 0) {
+    fprintf(stderr, "madvise failed: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+}
+
+/*
+ * mem_committed - bytes of the mapped pages in a range that are
+ *   committed
+ */
+size_t mem_committed(void *p, size_t sz)
+{
+  size_t i, bytes = 0;
+
+  (void)check_mapped(p, sz, 1);
+
+  for (i = 0; i < sz; i += APAGE_SIZE)
+    if (pagemap_is_committed(p + i))
+      bytes += APAGE_SIZE;
+  return bytes;
+}
+
+/*
+ * mem_map_mode - choose how mem_map maps pages, one of the MEM_MAP_
+ *   modes; 0 if the system lacks that mode
+ */
+int mem_map_mode(int mode)
+{
+  switch (mode) {
+  case MEM_MAP_PAGES:
+    map_unit = APAGE_SIZE;
+    return 1;
+#ifdef MADV_HUGEPAGE
+  case MEM_MAP_HUGE:
+    map_unit = HPAGE_SIZE;
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+/*
+ * mem_mapunit - size that mappings should be a multiple of to get the
+ *   current mode's pages
+ */
+size_t mem_mapunit(void)
+{
+  return map_unit;
+}
+
+/*
+ * mem_decommit_mode - choose how mem_decommit hands pages back, one
+ *   of the MEM_DECOMMIT_ modes; 0 if the system lacks that mode
+ */
+int mem_decommit_mode(int mode)
+{
+  switch (mode) {
+  case MEM_DECOMMIT_DONTNEED:
+    decommit_advice = MADV_DONTNEED;
+    return 1;
+#ifdef MADV_FREE
+  case MEM_DECOMMIT_FREE:
+    decommit_advice = MADV_FREE;
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
@@ -8,4 +8,22 @@ void *mem_map(size_t);
 void mem_unmap(void *, size_t);
 int mem_is_mapped(void *p, size_t sz);
 
+/* ways mem_map can map pages */
+#define MEM_MAP_PAGES 0   /* plain APAGE_SIZE pages */
+#define MEM_MAP_HUGE 1    /* whole huge pages aligned and advised MADV_HUGEPAGE */
+#define HPAGE_SIZE ((size_t)1 << 21)
+
+int mem_map_mode(int mode);
+size_t mem_mapunit(void);
+
+/* ways mem_decommit can hand pages back */
+#define MEM_DECOMMIT_DONTNEED 0   /* MADV_DONTNEED: dropped at once */
+#define MEM_DECOMMIT_FREE 1       /* MADV_FREE: dropped under memory pressure */
+
+size_t mem_decommit(void *p, size_t sz);
+size_t mem_recommit(void *p, size_t sz);
+size_t mem_committed(void *p, size_t sz);
+void mem_zero(void *p, size_t sz);
+int mem_decommit_mode(int mode);
+
 size_t mem_heapsize(void);
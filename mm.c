@@ -1,24 +1,176 @@
 /*
- * mm-naive.c - The least memory-efficient malloc package.
- * 
- * In this naive approach, a block is allocated by allocating a
- * new page as needed.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused.
+ * mm.c - Segregated-fit allocator over mapped chunks.
  *
- * The heap check and free check always succeeds, because the
- * allocator doesn't depend on any of the old data.
+ * Memory comes from mem_map and is managed in spans, runs of whole
+ * pages that end with a span descriptor linking them into their
+ * arena's span list. A chunk is a span in use: it holds a run of heap
+ * blocks ended by a zero-sized epilogue header, right in front of the
+ * descriptor. Spans not in use are free spans, kept on lists by page
+ * count. A mapping is made several times larger than the chunk it is
+ * made for and the rest is left as a free span above the chunk, which
+ * the chunk grows up into a page or so at a time as it fills up. When
+ * memlib is in huge page mode, mappings are whole 2 MB huge pages.
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * Every block starts with a one-word header holding its size, with
+ * the block's own allocated bit and its predecessor's allocated bit
+ * packed into the low bits. Only free blocks carry a footer, which
+ * is all coalesce needs to step back to a free predecessor, so an
+ * allocated block costs a single word of overhead.
+ *
+ * Free blocks are indexed by a two-level segregated fit (TLSF) table.
+ * The first level splits sizes by power of two and the second level
+ * splits each power-of-two range into SL_INDEX_COUNT linear bins.
+ * Each level has a bitmap of non-empty bins, so finding a bin that is
+ * guaranteed to hold a large enough block is a pair of find-first-set
+ * operations, and small blocks are found and indexed in O(1)
+ * regardless of the heap size. A bin of blocks of a page or more is
+ * not a list but a size tree: a treap ordered by size and then
+ * address, whose links live in the blocks themselves. A large request
+ * gets the smallest block that fits, the lowest of equal ones, in
+ * O(log n) of its bin, so big blocks are not carved up by a request
+ * that a smaller one would have served.
+ *
+ * The smaller bins are plain lists that a freed block is pushed onto
+ * the head of, so placement follows the order of the frees and live
+ * blocks end up scattered over every chunk. MM_OPT_ADDRESS_ORDER makes
+ * them size trees as well. A bin below SMALL_BLOCK_SIZE holds a single
+ * size, so its tree hands out its lowest block, and the others their
+ * best fit, lowest first; either way low addresses fill up first and
+ * the trailing chunks drain until free_chunk can let them go.
+ *
+ * Coalescing is deferred for small chunk blocks. A freed block of at
+ * most QUICK_MAX_SIZE bytes stays marked allocated, with a bit saying
+ * it is cached, on a quick list for its exact size, and a request of
+ * that size pops it back off without splitting anything. A quick list
+ * that is full is coalesced into the heap, and all of them are before
+ * a request that nothing in the TLSF index fits grows the heap, or
+ * once none of them has been reused for a while.
+ *
+ * A chunk whose blocks have all been freed becomes a free span again,
+ * merged with the free spans it touches, as long as another chunk
+ * remains. That span is retained for the next chunk the arena needs,
+ * and returned with mem_unmap once it has gone unused for a while or
+ * the arena retains more than its limit.
+ *
+ * mm_realloc resizes in place where it can, splitting a shrinking
+ * block and absorbing a free successor into a growing one, and only
+ * copies the payload when neither works.
+ *
+ * mm_calloc only clears memory that has been used. A span remembers
+ * whether its pages were written since they were mapped, and a free
+ * block carved from such pages is marked fresh until it is handed
+ * out; a fresh block reads as zeros but for its links and footer. A
+ * reused large mapping has its whole pages swapped for zero pages.
+ *
+ * mm_memalign serves any alignment from the chunks. It takes a free
+ * block big enough to hold an aligned block past a leading free block
+ * of its own, and returns the leading and trailing slack to the free
+ * index, so an aligned block costs no more than any other.
+ *
+ * mm_malloc_batch takes its arena's lock once for a whole batch of
+ * blocks of one size, and carves the chunk blocks of a batch one after
+ * another out of a single free block. mm_free_batch sorts its chunk
+ * blocks by address and releases each long run of neighbours as one
+ * block, so the run is coalesced and indexed once.
+ *
+ * A block is where its request size says: a slab slot up to
+ * SLAB_MAX_SIZE bytes, a chunk block below MMAP_THRESHOLD, and a chunk
+ * block or a mapping of its own above (a chunk block that mm_realloc
+ * grows stays where it is). That lets mm_realloc move a chunk block
+ * that shrinks to a slab size. mm_free_sized still looks the block up,
+ * since a small aligned block lives in a chunk, but frees a slab slot
+ * straight into its slab or thread cache and leaves the rest to
+ * mm_free.
+ * mm_usable_size tells how much of a block may be used, slot or
+ * alignment slack included, and mm_good_size what a request will get.
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes never reach the chunks. They
+ * are served from slab pages: a slab page holds slots of a single size
+ * class, records the class once in its header, and tracks its free
+ * slots with a bitmap, so small blocks carry no header at all. Slab
+ * pages are found from a payload pointer through the page registry,
+ * a radix tree over page numbers, and are unmapped as soon as their
+ * last slot is freed.
+ *
+ * Requests of MMAP_THRESHOLD bytes or more get a mapping of their own,
+ * headed by the mapping length and registered like a slab page. A
+ * freed large mapping is parked in a small cache for reuse by a later
+ * request of about the same size, or unmapped when it does not fit
+ * in the cache.
+ *
+ * All of the above is kept per arena: an arena has its own chunk
+ * list, TLSF index, slab lists and large cache. When there is more
+ * than one arena every page of a chunk is registered too, so any block
+ * leads back to its arena through the registry and the span, slab
+ * page or large header that owns it.
+ *
+ * mm_can_free answers in constant time. The first call on an arena
+ * gives each of its chunks a start bitmap, with a bit for every
+ * ALIGNMENT bytes that is set where a block in use starts, and from
+ * then on registers the chunks of a single arena too, so that any
+ * pointer leads to its chunk. Until then neither costs anything, and
+ * a heap that is never checked keeps its chunks out of the registry.
+ *
+ * mm_check walks the whole heap, unless MM_OPT_CHECK_FULL asks for a
+ * full walk only every so many calls. The calls in between walk just
+ * the chunks marked dirty since the last check, which the start bitmap
+ * upkeep marks for free, along with the span list, the bin bitmaps and
+ * the slab pages with free slots. Anything else is left to the next
+ * full walk, so memory scribbled on from outside calls for full ones.
+ *
+ * MM_OPT_SAMPLE_BYTES turns on a sampling heap profile. Each thread
+ * counts down the bytes it allocates and samples the block that takes
+ * the count below zero, recording its stack with backtrace() in a side
+ * table keyed by address until it is freed, and starts over from a
+ * random interval averaging the option's value. While sampling is off
+ * the countdown is all an allocation costs, and a free only checks
+ * that the table is empty. mm_heap_profile_dump writes the live
+ * samples out in the heap profile format pprof reads.
+ *
+ * mm_region_create makes a region, for blocks that are all freed at
+ * once. A region bumps a pointer through chunks of its own, mapped
+ * like the arenas' but kept apart from them, so its blocks have no
+ * headers and are never freed one by one: mm_region_destroy unmaps
+ * the region's chunks and nothing else. A region takes no lock, and is
+ * used by one thread at a time.
+ *
+ * mm_get_stats reports what the allocator has done since mm_init.
+ * Blocks allocated and freed are counted per size class by the thread
+ * that asked, in counters of its own, and the splits, merges, heap
+ * growths and free index searches by the arena that did them, under
+ * the lock it holds anyway. The counters cost an increment each.
+ *
+ * Built with -DMM_THREADS the allocator is thread-safe and has
+ * ARENA_COUNT arenas, each under its own lock. A thread is assigned
+ * the arena with the fewest threads, and moves to a less loaded one
+ * when it keeps finding its arena's lock taken; a block is always
+ * freed into the arena it came from. Each thread also keeps a small
+ * cache of freed slab slots per size class. A malloc/free pair of a
+ * small size is served from the cache without taking a lock or any
+ * other atomic operation; a lock is only taken to refill an empty
+ * class or to hand back half of a full one, and a thread's cache is
+ * handed back when the thread exits. A thread that frees a block of
+ * an arena other than its own does not wait for that arena's lock:
+ * it pushes the block onto the arena's remote list, a lock-free
+ * stack that the arena's own threads drain on their next malloc.
+ * mm_init must not run while other threads use the allocator.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <execinfo.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "pagemap.h"
+#include "sizeclasses.h"
 
 /* always use 16-byte alignment */
 #define ALIGNMENT 16
@@ -29,64 +181,4197 @@
 /* rounds up to the nearest multiple of mem_pagesize() */
 #define PAGE_ALIGN(size) (((size) + (mem_pagesize()-1)) & ~(mem_pagesize()-1))
 
-void *current_avail = NULL;
-int current_avail_size = 0;
+//size of a header or footer word
+#define WSIZE sizeof(size_t)
+
+//low bits of a header: this block is allocated, the previous block is
+//allocated, (free blocks only) some pages inside it are decommitted,
+//and (allocated blocks only) it is freed but cached on a quick list or
+//(free blocks only) it was never handed out, so it reads as zeros but
+//for its links and footer
+#define ALLOC_BIT 0x1
+#define PREV_ALLOC_BIT 0x2
+#define PURGED_BIT 0x4
+#define QUICK_BIT 0x8
+#define FRESH_BIT 0x8
+#define FLAG_MASK ((size_t)(ALIGNMENT-1))
+
+//Macros for working with raw pointer as a header or footer word:
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
+#define PACK(size, flags) ((size) | (flags))
+#define GET_SIZE(p) (GET(p) & ~FLAG_MASK)
+#define GET_ALLOC(p) (GET(p) & ALLOC_BIT)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC_BIT)
+#define SET_PREV_ALLOC(p) (GET(p) |= PREV_ALLOC_BIT)
+#define CLEAR_PREV_ALLOC(p) (GET(p) &= ~(size_t)PREV_ALLOC_BIT)
+
+//Macros for getting the header from a payload pointer
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+
+//Macro for getting the next block's payload
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+
+//Previous block's payload, only valid when that block is free
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - 2*WSIZE))
+
+//Gets the footer of a free block
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - 2*WSIZE)
+
+/* rounds down to the nearest multiple of mem_pagesize() */
+#define ADDRESS_PAGE_START(p) ((void *)(((size_t)p) & ~(mem_pagesize()-1)))
+
+//bytes at the end of every span taken by its descriptor
+#define SPAN_BYTES ALIGN(sizeof(span))
+
+//first byte of the span whose descriptor is s, and the byte past its end
+#define SPAN_START(s) ((char *)(s) + SPAN_BYTES - (s)->size)
+#define SPAN_END(s) ((char *)(s) + SPAN_BYTES)
+
+//bytes of a chunk used by the leading word, the epilogue and the descriptor
+#define CHUNK_OVERHEAD (2*WSIZE + SPAN_BYTES)
+
+//descriptor of the chunk starting at start, kept in the chunk's first word
+//so that the registry can name a chunk by its start while the end moves
+#define CHUNK_SPAN(start) (*(span **)(start))
+
+//payload of the first block in a chunk
+#define CHUNK_FIRST_BP(s) (SPAN_START(s) + ALIGNMENT)
+
+//header of the chunk's epilogue, right before its descriptor
+#define CHUNK_EPILOGUE(s) ((char *)(s) - WSIZE)
+
+//descriptor of the chunk that ends with the epilogue header hp
+#define EPILOGUE_SPAN(hp) ((span *)((char *)(hp) + WSIZE))
+
+//whether s is a free span right above the chunk before it in the list
+#define SPAN_ABOVE_CHUNK(s) ((s)->free && (s)->prev != NULL && !(s)->prev->free \
+			     && SPAN_END((s)->prev) == SPAN_START(s))
+
+//smallest block that can hold a header, the free-list links and a footer
+#define MIN_BLOCK_SIZE ALIGN(2*WSIZE + sizeof(unalloc_bp))
+
+//largest request whose mapping (SPAN_GROW times the request) still fits the index
+#define MAX_REQUEST ((size_t)1 << (FL_INDEX_MAX - 4))
+
+/*
+ * TLSF index parameters. Sizes below SMALL_BLOCK_SIZE all share first
+ * level 0 and are split linearly in ALIGNMENT steps; above that, the
+ * first level is the position of the highest set bit and the second
+ * level is the next SL_INDEX_COUNT_LOG2 bits. The bins of first level
+ * TREE_FL_INDEX and up, those of blocks of a page or more, are size
+ * trees; with MM_OPT_ADDRESS_ORDER set, so are all the others.
+ */
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+#define ALIGN_SIZE_LOG2 4
+#define FL_INDEX_MAX 40
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE ((size_t)1 << FL_INDEX_SHIFT)
+#define TREE_FL_INDEX (LOG_APAGE_SIZE - FL_INDEX_SHIFT + 1)
+
+//whether bin level fl of arena a is a size tree rather than a list
+#define BIN_IS_TREE(a, fl) ((fl) >= TREE_FL_INDEX || (a)->address_order)
+
+//whether free block x comes before free block y in a size tree: it is
+//smaller, or as big and lower in memory
+#define TREE_BEFORE(x, y) (GET_SIZE(HDRP(x)) < GET_SIZE(HDRP(y)) \
+			   || (GET_SIZE(HDRP(x)) == GET_SIZE(HDRP(y)) && (char *)(x) < (char *)(y)))
+
+//heap priority of a size tree node, a hash of its address; no node
+//has a higher priority than its parent
+#define TREE_PRIORITY(node) ((uintptr_t)(node) * (uintptr_t)0x9E3779B97F4A7C15UL)
+
+/*
+ * Span parameters. Free spans of fewer than SPAN_LISTS pages are kept
+ * on one list per page count and larger ones share the last list. A
+ * new mapping is SPAN_GROW times the size of the chunk it is made for.
+ * An emptied chunk is retained as a free span until RETAIN_DECAY span
+ * events have gone by without it being reused, and an arena retains at
+ * most RETAIN_BYTES of them unless MM_OPT_RETAIN_LIMIT says otherwise.
+ * When memlib maps huge pages, an arena only maps spans of them once
+ * its heap reaches HUGE_HEAP_MIN bytes, which can be overridden at
+ * build time: every span keeps a huge page or two committed, which
+ * small heaps cannot amortize.
+ */
+#define SPAN_LISTS 64
+#define SPAN_LIST(size) ((size) < SPAN_LISTS * APAGE_SIZE ? (int)((size) / APAGE_SIZE) - 1 : SPAN_LISTS - 1)
+#define SPAN_GROW 8
+#define RETAIN_DECAY 1024
+#define RETAIN_BYTES (256 * APAGE_SIZE)
+#ifndef HUGE_HEAP_MIN
+#define HUGE_HEAP_MIN (16 * HPAGE_SIZE)
+#endif
+
+/*
+ * A free chunk block of at least PURGE_BYTES, unless MM_OPT_PURGE_BYTES
+ * says otherwise, decommits the pages wholly inside it; its header,
+ * links and footer stay committed.
+ */
+#define PURGE_BYTES (32 * APAGE_SIZE)
+
+/*
+ * Quick list parameters. A freed chunk block of at most QUICK_MAX_SIZE
+ * bytes is cached on the quick list for its exact size, which holds at
+ * most QUICK_COUNT blocks before it is coalesced back into the heap.
+ * All of them are coalesced once QUICK_DECAY frees have gone by without
+ * a cached block being reused.
+ */
+#define QUICK_MAX_SIZE 1024
+#define QUICK_LISTS (QUICK_MAX_SIZE / ALIGNMENT)
+#define QUICK_LIST(size) ((size) / ALIGNMENT - 1)
+#define QUICK_COUNT 8
+#define QUICK_DECAY 256
+
+//next block on a quick list, kept in a cached block's first word
+#define QUICK_NEXT(bp) (*(void **)(bp))
+
+//chunk blocks mm_free_batch sorts in a buffer on its stack; a bigger
+//batch maps a buffer for the time of the call
+#define BATCH_SORT 256
+
+//values of span.free
+#define SPAN_IN_USE 0
+#define SPAN_FREE 1
+#define SPAN_RETAINED 2
+
+/*
+ * Slab parameters. Each slab page serves one class of SLAB_SLOT_SIZE
+ * bytes, with the slots following the slab_page header. The classes
+ * come from sizeclasses.h, which sizeclasses generates from traces.
+ */
+#define SLAB_MAX_SIZE SIZE_CLASS_MAX
+#define SLAB_CLASS_COUNT SIZE_CLASS_COUNT
+#define SLAB_CLASS(size) (size_class_index[((size) - 1) / ALIGNMENT])
+#define SLAB_SLOT_SIZE(class) (size_class_size[class])
+#define SLAB_BITMAP_WORDS (APAGE_SIZE / ALIGNMENT / 64)
+#define SLAB_FIRST_SLOT(slab) ((char *)(slab) + ALIGN(sizeof(slab_page)))
+#define SLAB_SLOTS(class) ((APAGE_SIZE - ALIGN(sizeof(slab_page))) / SLAB_SLOT_SIZE(class))
+
+//the slab_page header as the preprocessor can size it, so that a class
+//too big for a slab page stops the build instead of mm_check
+#define SLAB_HEADER_BYTES ALIGN(3*__SIZEOF_POINTER__ + 2*__SIZEOF_INT__ \
+				+ SLAB_BITMAP_WORDS*__SIZEOF_LONG__)
+#if SIZE_CLASS_MAX > APAGE_SIZE - SLAB_HEADER_BYTES
+#error "a slab page has no room for a slot of the largest size class"
+#endif
+
+/*
+ * Large block parameters. MMAP_THRESHOLD can be overridden at build
+ * time; the cache holds at most LARGE_CACHE_SLOTS freed mappings and
+ * LARGE_CACHE_BYTES bytes, and only hands a mapping to a request that
+ * needs at least LARGE_CACHE_FIT of it. mm_calloc clears a reused
+ * mapping by swapping in zero pages once that spares it clearing
+ * LARGE_ZERO_BYTES or more.
+ */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (4 * APAGE_SIZE)
+#endif
+#define LARGE_CACHE_SLOTS 8
+#define LARGE_CACHE_BYTES (64 * APAGE_SIZE)
+#define LARGE_CACHE_FIT(need, length) ((need) >= (length) - (length) / 4)
+#define LARGE_PAYLOAD(large) ((char *)(large) + sizeof(large_header))
+#define LARGE_ZERO_BYTES (16 * APAGE_SIZE)
+
+/*
+ * Region parameters. A region starts with a chunk of REGION_CHUNK_SIZE
+ * bytes and maps each next one twice as big, up to REGION_CHUNK_MAX; a
+ * request that does not fit such a chunk gets one of its own size.
+ */
+#define REGION_CHUNK_SIZE (16 * APAGE_SIZE)
+#define REGION_CHUNK_MAX (1024 * APAGE_SIZE)
+#define REGION_CHUNK_BYTES ALIGN(sizeof(region_chunk))
+
+/*
+ * Per-thread cache parameters. A thread keeps at most TCACHE_COUNT
+ * freed slots per slab class, and moves TCACHE_BATCH slots at a time
+ * between its cache and the slab pages.
+ */
+#define TCACHE_COUNT 32
+#define TCACHE_BATCH (TCACHE_COUNT / 2)
+
+/*
+ * Arena parameters. ARENA_COUNT can be overridden at build time; a
+ * thread that has to wait for its arena's lock ARENA_CONTENTION_LIMIT
+ * times in a row is moved to a less loaded arena.
+ */
+#ifndef ARENA_COUNT
+#ifdef MM_THREADS
+#define ARENA_COUNT 4
+#else
+#define ARENA_COUNT 1
+#endif
+#endif
+#define ARENA_CONTENTION_LIMIT 4
+
+/*
+ * Statistics classes. mm_get_stats counts blocks in the slab class of
+ * their size, then as chunk blocks and as large mappings; a freed
+ * block goes by the kind its registry entry names.
+ */
+#define STATS_CHUNK SLAB_CLASS_COUNT
+#define STATS_LARGE (SLAB_CLASS_COUNT + 1)
+#define STATS_CLASSES (SLAB_CLASS_COUNT + 2)
+#define STATS_CLASS(size) ((size) <= SLAB_MAX_SIZE ? (int)SLAB_CLASS(size) \
+			   : (size) < MMAP_THRESHOLD ? STATS_CHUNK : STATS_LARGE)
+#define STATS_ENTRY_CLASS(entry) (REG_KIND(entry) == REG_SLAB ? (int)((slab_page *)REG_OWNER(entry))->class \
+				  : REG_KIND(entry) == REG_LARGE ? STATS_LARGE : STATS_CHUNK)
+#if SIZE_CLASS_COUNT + 2 > MM_STATS_CLASSES
+#error "mm_stats_t has no room for every size class"
+#endif
+
+//with one arena a chunk block needs no lookup, so chunks stay out of
+//the registry and do not cost small heaps its node pages, until
+//mm_can_free gives them start bitmaps and needs them found
+#define CHUNK_REGISTERED(s) (ARENA_COUNT > 1 || (s)->starts != NULL)
+
+//bytes of the start bitmap of a chunk that may grow to limit bytes,
+//one bit per ALIGNMENT bytes, and the bit of the block at bp
+#define STARTS_BYTES(limit) PAGE_ALIGN((limit) / ALIGNMENT / 8)
+#define START_BIT(s, bp) ((size_t)((char *)(bp) - SPAN_START(s)) / ALIGNMENT)
+#define STARTS_GET(s, bit) (((s)->starts[(bit) / 64] >> ((bit) % 64)) & 1)
+
+//whether a is the address of one of the arenas
+#define ARENA_VALID(a) ((arena *)(a) >= arenas && (arena *)(a) < arenas + ARENA_COUNT \
+			&& ((char *)(a) - (char *)arenas) % sizeof(arena) == 0)
+
+/*
+ * Page registry parameters. A page number is split into REG_LEVELS
+ * indexes of REG_BITS bits below a static root; every other node is
+ * one mapped page of REG_FANOUT entries.
+ */
+#define REG_BITS 9
+#define REG_FANOUT (1 << REG_BITS)
+#define REG_LEVELS 3
+#define REG_ROOT_BITS (47 - LOG_APAGE_SIZE - REG_LEVELS*REG_BITS)
+#define REG_ROOT_FANOUT (1 << REG_ROOT_BITS)
+#define REG_INDEX(key, level) (((key) >> ((level) * REG_BITS)) & (REG_FANOUT - 1))
+
+/*
+ * Heap sampling parameters. A sampled block keeps at most SAMPLE_DEPTH
+ * frames of the stack that allocated it, in a table of at least
+ * SAMPLE_SLOTS slots kept at most half full. While sampling is off a
+ * thread looks whether it was turned on every SAMPLE_IDLE_BYTES bytes
+ * it allocates.
+ */
+#define SAMPLE_DEPTH 32
+#define SAMPLE_SLOTS 256
+#define SAMPLE_IDLE_BYTES (64L << 20)
+
+//whether an allocation of size bytes is the one to sample: while
+//sampling is off, a single decrement and branch
+#define SAMPLE_DUE(size) ((sample_left -= (long)(size)) < 0)
+
+//home slot of sampled block p in a table of slots slots
+#define SAMPLE_HOME(p, slots) (((uintptr_t)(p) * (uintptr_t)0x9E3779B97F4A7C15UL >> 32) & ((slots) - 1))
+
+//a registry entry is the owner of the page tagged with the kind of page
+#define REG_SLAB 0x1
+#define REG_LARGE 0x2
+#define REG_CHUNK 0x3
+#define REG_KIND_MASK ((uintptr_t)(ALIGNMENT-1))
+#define REG_ENTRY(owner, kind) ((void *)((uintptr_t)(owner) | (kind)))
+#define REG_KIND(entry) ((uintptr_t)(entry) & REG_KIND_MASK)
+#define REG_OWNER(entry) ((void *)((uintptr_t)(entry) & ~REG_KIND_MASK))
+
+//a chunk page's entry also holds the chunk's arena in the page offset
+//bits of the chunk start, so that a lookup without the arena's lock
+//never reads the chunk, whose descriptor moves as the chunk grows
+#define REG_CHUNK_ENTRY(start, a) REG_ENTRY((uintptr_t)(start) \
+		| (uintptr_t)((a) - arenas) << ALIGN_SIZE_LOG2, REG_CHUNK)
+#define REG_CHUNK_START(entry) ((char *)((uintptr_t)(entry) & ~(uintptr_t)(APAGE_SIZE - 1)))
+#define REG_CHUNK_ARENA(entry) (&arenas[((uintptr_t)(entry) & (APAGE_SIZE - 1)) >> ALIGN_SIZE_LOG2])
+#if ARENA_COUNT > APAGE_SIZE / ALIGNMENT
+#error "chunk registry entries have no room for every arena index"
+#endif
+
+//links kept in the payload of a free block
+typedef struct unalloc_bp {
+	struct unalloc_bp *prev;
+	struct unalloc_bp *next;
+} unalloc_bp;
+
+//the same words in a free block in a size tree
+typedef struct tree_bp {
+	struct tree_bp *left;
+	struct tree_bp *right;
+} tree_bp;
+
+//descriptor at the end of every span; chunks are the spans in use
+typedef struct span {
+	struct span *next;
+	struct span *prev;
+	size_t size;
+	struct arena *arena;
+	//free spans only: links on the list for the span's size, links on
+	//the arena's retained list and the span clock when a retained span
+	//was emptied, and whether its pages have not been written since
+	//they were mapped
+	struct span *free_next;
+	struct span *free_prev;
+	int free;
+	struct span *retained_next;
+	struct span *retained_prev;
+	unsigned int retained_at;
+	int fresh;
+	//chunks only: whether a block changed since mm_check last walked
+	//the chunk, the size the chunk may grow to, and a bit for each
+	//ALIGNMENT bytes set where a block in use starts, or NULL
+	int dirty;
+	size_t limit;
+	unsigned long *starts;
+} span;
+
+//header at the start of every slab page
+typedef struct slab_page {
+	struct slab_page *next;
+	struct slab_page *prev;
+	unsigned int class;
+	unsigned int nfree;
+	struct arena *arena;
+	unsigned long used[SLAB_BITMAP_WORDS];
+} slab_page;
+
+//header at the start of a large block's own mapping
+typedef struct large_header {
+	size_t length;
+	struct arena *arena;
+} large_header;
+
+//one independent heap
+typedef struct arena {
+#ifdef MM_THREADS
+	pthread_mutex_t lock;
+#endif
+	//span list in mapping order, and the number of chunks and of
+	//registered pages in them
+	span *first_span;
+	span *last_span;
+	int chunk_count;
+	size_t chunk_pages;
+
+	//free spans by size, with a bitmap of the non-empty lists
+	unsigned long span_bitmap;
+	span *span_free[SPAN_LISTS];
+
+	//retained spans from oldest to newest, their bytes, the count of
+	//span events that ages them, and how often they were reused,
+	//missing or unmapped
+	span *retained_oldest;
+	span *retained_newest;
+	size_t retained;
+	unsigned int span_clock;
+	unsigned long retain_hits;
+	unsigned long retain_misses;
+	unsigned long retain_releases;
+
+	//TLSF index: bitmaps of non-empty bins, the list heads of the small
+	//bins and the tree roots of the large ones, or of every bin when
+	//address_order is set
+	int address_order;
+	unsigned long fl_bitmap;
+	unsigned int sl_bitmap[FL_INDEX_COUNT];
+	unalloc_bp *free_lists[TREE_FL_INDEX][SL_INDEX_COUNT];
+	tree_bp *free_trees[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+	//freed chunk blocks cached by exact size, their count per list and
+	//in all, and the frees since a cached block was last reused
+	void *quick[QUICK_LISTS];
+	unsigned char quick_count[QUICK_LISTS];
+	int quick_cached;
+	unsigned int quick_idle;
+
+	//slab pages with at least one free slot, per class
+	slab_page *slab_partial[SLAB_CLASS_COUNT];
+	size_t slab_count;
+
+	//live large mappings, and freed ones parked for reuse
+	size_t large_count;
+	struct {
+		large_header *large;
+		size_t length;
+	} large_cache[LARGE_CACHE_SLOTS];
+	int large_cached;
+	size_t large_cached_bytes;
+
+	//blocks other threads have freed, linked through their first word
+	void *remote;
+	unsigned long remote_frees;
+
+	//bytes committed now and at most, lock acquisitions, assigned threads
+	size_t heap_size;
+	size_t heap_peak;
+	unsigned long locks;
+	unsigned long contended;
+	int threads;
+
+	//whether every chunk keeps its start bitmap and dirty flag up to date
+	int keep_starts;
+
+	//chunk blocks split and merged, chunk growths and releases, spans
+	//mapped in huge pages, and free index searches with the bins and
+	//size tree nodes they looked at
+	unsigned long splits;
+	unsigned long coalesces;
+	unsigned long extends;
+	unsigned long chunk_releases;
+	unsigned long huge_spans;
+	unsigned long searches;
+	unsigned long search_steps;
+} arena;
+
+#ifdef MM_THREADS
+//a thread's cached slots, linked through their first word
+typedef struct thread_cache {
+	void *head[SLAB_CLASS_COUNT];
+	unsigned int count[SLAB_CLASS_COUNT];
+} thread_cache;
+#endif
+
+//blocks a thread allocated and freed per statistics class; with
+//threads, every thread that used the allocator is on a list, with a
+//pointer to its cache
+typedef struct thread_stats {
+	unsigned long mallocs[STATS_CLASSES];
+	unsigned long frees[STATS_CLASSES];
+#ifdef MM_THREADS
+	thread_cache *cache;
+	struct thread_stats *next;
+	struct thread_stats *prev;
+#endif
+} thread_stats;
+
+//a sampled block, its requested size and the stack that allocated it,
+//innermost frame first; p is NULL in an empty table slot
+typedef struct sample {
+	void *p;
+	size_t size;
+	int depth;
+	void *stack[SAMPLE_DEPTH];
+} sample;
+
+//the start of a region's chunk: the region's next older chunk and the
+//length of the chunk's mapping
+typedef struct region_chunk {
+	struct region_chunk *next;
+	size_t size;
+} region_chunk;
+
+//a region, at the start of its first chunk: its chunks, newest first
+//but for any mapped for a single request, the room left in the one it
+//bumps through, and the size of its next chunk
+struct mm_region {
+	region_chunk *chunks;
+	char *next;
+	char *end;
+	size_t chunk_size;
+};
+
+
+
+void *extend(arena *a, size_t size);
+void set_allocated(arena *a, void *bp, size_t size);
+void *coalesce(arena *a, void *bp);
+static void purge_block(arena *a, void *bp, char *lo, char *hi);
+int ptr_is_mapped(void *p, size_t len);
+static int range_committed(void *p, size_t len);
+static void insert_free(arena *a, void *bp);
+static void remove_free(arena *a, void *bp);
+static void *find_fit(arena *a, size_t size);
+static void tree_insert(tree_bp **root, void *bp);
+static void tree_remove(tree_bp **root, void *bp);
+static void *tree_find(tree_bp *root, size_t size, unsigned long *steps);
+static void mapping_insert(size_t size, int *fl, int *sl);
+static span *span_new(arena *a, size_t size);
+static span *span_find(arena *a, size_t size);
+static void span_release(arena *a, span *s);
+static void span_trim(arena *a);
+static void *new_chunk(arena *a, span *s, size_t size);
+static size_t grow_size(span *c, size_t size);
+static void *grow_chunk(arena *a, span *c, size_t size);
+static void free_chunk(arena *a, span *c);
+static void chunk_mark(arena *a, void *bp, int used);
+static int chunk_keep_starts(arena *a, span *s);
+static int arena_keep_starts(arena *a);
+static void *slab_malloc(arena *a, size_t size);
+static void slab_free(slab_page *slab, void *p);
+static int slab_can_free(slab_page *slab, void *p);
+static int check_slabs(arena *a, int full);
+static void *large_malloc(arena *a, size_t size, int zero);
+static void large_free(large_header *large);
+static int check_large(arena *a);
+static int check_large_block(large_header *large);
+static region_chunk *region_map(size_t size);
+static void *region_grow(mm_region_t *r, size_t size);
+static void *registry_get(void *p);
+static int registry_set(void *p, void *entry);
+static int registry_set_pages(void *p, size_t size, void *entry);
+static int check_registry(size_t expected);
+static void free_block(arena *a, void *ptr);
+static int ptr_order(const void *p, const void *q);
+static void free_sorted(void **ptrs, size_t m, arena **locked);
+static void release_block(arena *a, void *ptr);
+static void quick_flush(arena *a, int list);
+static void quick_flush_all(arena *a);
+static int check_quick(arena *a, int cached);
+static int check_bitmaps(arena *a);
+static void *heap_malloc(arena *a, size_t size, int zero);
+static void *heap_memalign(arena *a, size_t align, size_t size);
+static size_t heap_malloc_batch(arena *a, size_t size, size_t n, void **out);
+static void heap_free(void *entry, void *ptr);
+static void *heap_realloc(arena *a, void *entry, void *ptr, size_t size);
+static void sample_alloc(void *bp, size_t size);
+static void sample_free(void *p);
+static int check_samples(void);
+static void stats_fold(unsigned long *mallocs, unsigned long *frees, thread_stats *t);
+static int check_heap(int full);
+static int check_chunks(arena *a, int full);
+static int heap_can_free(void *entry, void *p);
+static arena *entry_arena(void *entry);
+static arena *lock_thread_arena(void);
+static void arena_lock(arena *a);
+static void arena_unlock(arena *a);
+static void *arena_map(arena *a, size_t size);
+static void arena_unmap(arena *a, void *p, size_t size);
+static void arena_decommit(arena *a, void *p, size_t size);
+static void arena_recommit(arena *a, void *p, size_t size);
+static void arena_zero(void *p, size_t size);
+#ifdef MM_THREADS
+static void *tcache_malloc(unsigned int class);
+static void tcache_free(unsigned int class, void *p);
+static void tcache_flush(thread_cache *cache, unsigned int class, unsigned int n);
+static int tcache_holds(void *p);
+static void thread_register(void);
+static int check_tcache(void);
+static void remote_push(arena *a, void *p);
+static void arena_drain(arena *a);
+static int check_remote(arena *a);
+#endif
+
+static arena arenas[ARENA_COUNT];
+
+//page registry: top level of the radix tree and count of mapped nodes
+static void *reg_root[REG_ROOT_FANOUT];
+static size_t reg_nodes;
+
+#ifdef MM_THREADS
+//the registry and memlib are shared by all arenas, each under its own lock
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//this thread's cached slots and block counts
+static __thread thread_cache tcache;
+static __thread thread_stats tstats;
+
+//the block counts of live threads and the sum of those that exited
+static thread_stats *stats_threads;
+static thread_stats stats_exited;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//a thread's arena, and how many times in a row it found it locked
+static __thread arena *tarena;
+static __thread int tcontention;
+
+//its destructor cleans up after a thread that used the allocator
+static __thread int tregistered;
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+//where the next arena search starts, to spread ties round-robin
+static unsigned int arena_next;
+
+//whether other arenas' blocks go onto their remote lists (MM_OPT_REMOTE_FREE)
+static int remote_free = 1;
+#endif
+
+//most bytes of emptied chunks an arena retains (MM_OPT_RETAIN_LIMIT)
+static size_t retain_limit = RETAIN_BYTES;
+
+//smallest free block that decommits its pages, 0 for none (MM_OPT_PURGE_BYTES)
+static size_t purge_bytes = PURGE_BYTES;
+
+//mm_check walks the whole heap on every this many calls and only the
+//chunks changed since the last check on the others (MM_OPT_CHECK_FULL),
+//and the calls since the last full walk
+static long check_full = 1;
+static long check_calls;
+
+//whether mm_init gives every arena address-ordered bins (MM_OPT_ADDRESS_ORDER)
+static int address_order;
+
+#ifndef MM_THREADS
+//block counts of the only thread
+static thread_stats tstats;
+#endif
+
+//bytes taken with mem_map and given back with mem_unmap
+static size_t mapped_bytes;
+static size_t unmapped_bytes;
+
+//mean bytes allocated between sampled blocks, 0 for no sampling
+//(MM_OPT_SAMPLE_BYTES), and the bytes this thread allocates before
+//its next sample
+static long sample_bytes;
+#ifdef MM_THREADS
+static __thread long sample_left;
+static __thread uint64_t sample_seed;
+#else
+static long sample_left;
+static uint64_t sample_seed;
+#endif
+
+//live sampled blocks: an open addressing table of sample_slots slots
+//with linear probing, and how many are in use
+static sample *samples;
+static size_t sample_slots;
+static size_t sample_live;
+#ifdef MM_THREADS
+static pthread_mutex_t sample_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * fls - index of the most significant set bit, size must be nonzero
+ */
+static int fls(size_t size)
+{
+	return (int)(sizeof(size_t) * 8 - 1) - __builtin_clzl(size);
+}
+
+/*
+ * mapping_insert - bin whose size range contains size
+ */
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+	if (size < SMALL_BLOCK_SIZE) {
+		*fl = 0;
+		*sl = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+	} else {
+		int f = fls(size);
+		*sl = (int)(size >> (f - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+		*fl = f - (FL_INDEX_SHIFT - 1);
+	}
+}
+
+/*
+ * mapping_search - first bin whose every block is at least size bytes
+ */
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+	if (size >= SMALL_BLOCK_SIZE)
+		size += ((size_t)1 << (fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+	mapping_insert(size, fl, sl);
+}
 
-/* 
+/*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
-  current_avail = NULL;
-  current_avail_size = 0;
-  
-  return 0;
+	size_t size;
+	span *s;
+	int i;
+#ifdef MM_THREADS
+	thread_stats *t;
+#endif
+
+	memset(arenas, 0, sizeof(arenas));
+	for (i = 0; i < ARENA_COUNT; i++)
+		arenas[i].address_order = address_order;
+#ifdef MM_THREADS
+	for (i = 0; i < ARENA_COUNT; i++)
+		pthread_mutex_init(&arenas[i].lock, NULL);
+	memset(&tcache, 0, sizeof(tcache));
+	tarena = NULL;
+	tcontention = 0;
+	//the first thread to ask gets arenas[0], which holds the first chunk
+	arena_next = 0;
+	pthread_mutex_lock(&stats_lock);
+	for (t = stats_threads; t != NULL; t = t->next) {
+		memset(t->mallocs, 0, sizeof(t->mallocs));
+		memset(t->frees, 0, sizeof(t->frees));
+	}
+	memset(&stats_exited, 0, sizeof(stats_exited));
+	pthread_mutex_unlock(&stats_lock);
+	memset(tstats.mallocs, 0, sizeof(tstats.mallocs));
+	memset(tstats.frees, 0, sizeof(tstats.frees));
+#else
+	memset(&tstats, 0, sizeof(tstats));
+#endif
+	mapped_bytes = 0;
+	unmapped_bytes = 0;
+	memset(reg_root, 0, sizeof(reg_root));
+	reg_nodes = 0;
+	check_calls = 0;
+	samples = NULL;
+	sample_slots = 0;
+	sample_live = 0;
+	sample_left = 0;
+
+	//a one-page chunk for the first arena, with room above it to grow;
+	//the others get their first chunk when they first need one
+	size = PAGE_ALIGN(CHUNK_OVERHEAD);
+	s = span_new(&arenas[0], SPAN_GROW * size);
+	if (s == NULL)
+		return -1;
+	if (new_chunk(&arenas[0], s, size) == NULL) {
+		span_release(&arenas[0], s);
+		return -1;
+	}
+
+	return 0;
 }
 
-/* 
- * mm_malloc - Allocate a block by using bytes from current_avail,
- *     grabbing a new page if necessary.
+/*
+ * mm_malloc - Allocate a block, from this thread's cache when the
+ *     thread-safe build has a slot of the right class at hand, and
+ *     otherwise from the thread's arena.
  */
 void *mm_malloc(size_t size)
 {
-  int newsize = ALIGN(size);
-  void *p;
-  
-  if (current_avail_size < newsize) {
-    current_avail_size = PAGE_ALIGN(newsize);
-    current_avail = mem_map(current_avail_size);
-    if (current_avail == NULL)
-      return NULL;
-  }
+	arena *a;
+	void *bp;
+
+	if (size == 0 || size > MAX_REQUEST)
+		return NULL;
+
+#ifdef MM_THREADS
+	if (size <= SLAB_MAX_SIZE) {
+		bp = tcache_malloc(SLAB_CLASS(size));
+		if (SAMPLE_DUE(size))
+			sample_alloc(bp, size);
+		return bp;
+	}
+#endif
 
-  p = current_avail;
-  current_avail += newsize;
-  current_avail_size -= newsize;
-  
-  return p;
+	a = lock_thread_arena();
+	bp = heap_malloc(a, size, 0);
+	arena_unlock(a);
+	if (bp != NULL)
+		tstats.mallocs[STATS_CLASS(size)]++;
+	if (SAMPLE_DUE(size))
+		sample_alloc(bp, size);
+	return bp;
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_malloc_batch - Allocate n blocks of size bytes into out, taking
+ *     the arena's lock once for all of them. Returns how many were
+ *     allocated, which is less than n only when memory ran out.
  */
-void mm_free(void *ptr)
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
 {
+	arena *a;
+	size_t i, j;
+
+	if (size == 0 || size > MAX_REQUEST)
+		return 0;
+
+#ifdef MM_THREADS
+	if (size <= SLAB_MAX_SIZE) {
+		for (i = 0; i < n; i++)
+			if ((out[i] = tcache_malloc(SLAB_CLASS(size))) == NULL)
+				break;
+		for (j = 0; j < i; j++)
+			if (SAMPLE_DUE(size))
+				sample_alloc(out[j], size);
+		return i;
+	}
+#endif
+
+	a = lock_thread_arena();
+	if (size > SLAB_MAX_SIZE && size < MMAP_THRESHOLD)
+		i = heap_malloc_batch(a, size, n, out);
+	else
+		for (i = 0; i < n; i++)
+			if ((out[i] = heap_malloc(a, size, 0)) == NULL)
+				break;
+	arena_unlock(a);
+	tstats.mallocs[STATS_CLASS(size)] += i;
+	for (j = 0; j < i; j++)
+		if (SAMPLE_DUE(size))
+			sample_alloc(out[j], size);
+	return i;
 }
 
 /*
- * mm_check - Check whether the heap is ok, so that mm_malloc()
- *            and proper mm_free() calls won't crash.
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ *     Chunk memory that was never handed out and fresh large mappings
+ *     are zero already, so only recycled memory is cleared.
  */
-int mm_check()
+void *mm_calloc(size_t nmemb, size_t size)
 {
-  return 1;
+	arena *a;
+	void *bp;
+
+	if (nmemb != 0 && size > MAX_REQUEST / nmemb)
+		return NULL;
+	size *= nmemb;
+	if (size == 0)
+		return NULL;
+
+#ifdef MM_THREADS
+	if (size <= SLAB_MAX_SIZE) {
+		bp = tcache_malloc(SLAB_CLASS(size));
+		if (bp != NULL)
+			memset(bp, 0, size);
+		if (SAMPLE_DUE(size))
+			sample_alloc(bp, size);
+		return bp;
+	}
+#endif
+
+	a = lock_thread_arena();
+	bp = heap_malloc(a, size, 1);
+	arena_unlock(a);
+	if (bp != NULL)
+		tstats.mallocs[STATS_CLASS(size)]++;
+	if (SAMPLE_DUE(size))
+		sample_alloc(bp, size);
+	return bp;
 }
 
 /*
- * mm_check - Check whether freeing the given `p`, which means that
- *            calling mm_free(p) leaves the heap in an ok state.
+ * mm_memalign - Allocate a block whose payload is a multiple of align
+ *     bytes, a power of two, from this thread's arena.
  */
-int mm_can_free(void *p)
+void *mm_memalign(size_t align, size_t size)
+{
+	arena *a;
+	void *bp;
+
+	if (align == 0 || (align & (align - 1)) != 0 || align > MAX_REQUEST)
+		return NULL;
+	if (align <= ALIGNMENT)
+		return mm_malloc(size);
+	if (size == 0 || size > MAX_REQUEST)
+		return NULL;
+
+	a = lock_thread_arena();
+	bp = heap_memalign(a, align, size);
+	arena_unlock(a);
+	if (bp != NULL)
+		tstats.mallocs[STATS_CHUNK]++;
+	if (SAMPLE_DUE(size))
+		sample_alloc(bp, size);
+	return bp;
+}
+
+/*
+ * heap_malloc - Allocate a block from the smallest non-empty TLSF bin
+ *     of arena a that is guaranteed to fit, grabbing a new chunk if
+ *     necessary; with zero set, its first size bytes are zeroed.
+ */
+static void *heap_malloc(arena *a, size_t size, int zero)
+{
+	size_t newsize, fresh;
+	char *footer;
+	void *bp;
+
+	if (size <= SLAB_MAX_SIZE) {
+		bp = slab_malloc(a, size);
+		if (zero && bp != NULL)
+			memset(bp, 0, size);
+		return bp;
+	}
+	if (size >= MMAP_THRESHOLD)
+		return large_malloc(a, size, zero);
+
+	newsize = ALIGN(size + WSIZE);
+	if (newsize < MIN_BLOCK_SIZE)
+		newsize = MIN_BLOCK_SIZE;
+
+	//a cached block of the exact size is reused as it is
+	if (newsize <= QUICK_MAX_SIZE && (bp = a->quick[QUICK_LIST(newsize)]) != NULL) {
+		a->quick[QUICK_LIST(newsize)] = QUICK_NEXT(bp);
+		a->quick_count[QUICK_LIST(newsize)]--;
+		a->quick_cached--;
+		a->quick_idle = 0;
+		PUT(HDRP(bp), GET(HDRP(bp)) & ~(size_t)QUICK_BIT);
+		chunk_mark(a, bp, 1);
+		if (zero)
+			memset(bp, 0, size);
+		return bp;
+	}
+
+	//coalesce the cached blocks before growing the heap for them
+	bp = find_fit(a, newsize);
+	if (bp == NULL && a->quick_cached != 0) {
+		quick_flush_all(a);
+		bp = find_fit(a, newsize);
+	}
+	if (bp == NULL)
+		bp = extend(a, newsize);
+	if (bp == NULL)
+		return NULL;
+
+	fresh = GET(HDRP(bp)) & FRESH_BIT;
+	footer = FTRP(bp);
+	remove_free(a, bp);
+	set_allocated(a, bp, newsize);
+
+	//a fresh block holds nothing but its links and, unless it was
+	//split, its footer
+	if (zero && fresh) {
+		memset(bp, 0, sizeof(unalloc_bp));
+		if (footer < (char *)bp + size)
+			PUT(footer, 0);
+	} else if (zero)
+		memset(bp, 0, size);
+	return bp;
+}
+
+/*
+ * heap_malloc_batch - Allocate n chunk blocks of size bytes into out:
+ *     cached blocks of the exact size first, then the rest side by side
+ *     from one free block big enough for all of them, so that only the
+ *     last one splits. Falls back to heap_malloc when no such block can
+ *     be had. Returns how many blocks were allocated.
+ */
+static size_t heap_malloc_batch(arena *a, size_t size, size_t n, void **out)
+{
+	size_t newsize, total, flags, i = 0, k;
+	char *bp, *start, *end;
+
+	newsize = ALIGN(size + WSIZE);
+	if (newsize < MIN_BLOCK_SIZE)
+		newsize = MIN_BLOCK_SIZE;
+
+	if (newsize <= QUICK_MAX_SIZE) {
+		while (i < n && (bp = a->quick[QUICK_LIST(newsize)]) != NULL) {
+			a->quick[QUICK_LIST(newsize)] = QUICK_NEXT(bp);
+			a->quick_count[QUICK_LIST(newsize)]--;
+			a->quick_cached--;
+			PUT(HDRP(bp), GET(HDRP(bp)) & ~(size_t)QUICK_BIT);
+			chunk_mark(a, bp, 1);
+			out[i++] = bp;
+			a->quick_idle = 0;
+		}
+	}
+	if (i == n)
+		return n;
+
+	bp = NULL;
+	if (n - i <= MAX_REQUEST / newsize) {
+		total = (n - i) * newsize;
+		bp = find_fit(a, total);
+		if (bp == NULL && a->quick_cached != 0) {
+			quick_flush_all(a);
+			bp = find_fit(a, total);
+		}
+		if (bp == NULL)
+			bp = extend(a, total);
+	}
+
+	//without room for them side by side they come one at a time
+	if (bp == NULL) {
+		for (; i < n; i++)
+			if ((out[i] = heap_malloc(a, size, 0)) == NULL)
+				break;
+		return i;
+	}
+	remove_free(a, bp);
+
+	//recommit purged pages under all the blocks before laying them out
+	flags = GET(HDRP(bp)) & (PURGED_BIT | FRESH_BIT);
+	if (flags & PURGED_BIT) {
+		start = ADDRESS_PAGE_START(HDRP(bp));
+		end = bp + total + sizeof(unalloc_bp);
+		if (end > FTRP(bp))
+			end = FTRP(bp);
+		arena_recommit(a, start, PAGE_ALIGN((size_t)(end - start)));
+	}
+
+	//all but the last block are laid out here; the last one takes the
+	//rest of the free block, splitting it in set_allocated
+	total = GET_SIZE(HDRP(bp));
+	for (k = n - i; k > 1; k--) {
+		a->splits++;
+		PUT(HDRP(bp), PACK(newsize, ALLOC_BIT | GET_PREV_ALLOC(HDRP(bp))));
+		chunk_mark(a, bp, 1);
+		out[i++] = bp;
+		bp += newsize;
+		total -= newsize;
+		PUT(HDRP(bp), PACK(total, PREV_ALLOC_BIT | flags));
+	}
+	set_allocated(a, bp, newsize);
+	out[i++] = bp;
+	return i;
+}
+
+/*
+ * heap_memalign - Allocate a chunk block of arena a whose payload is
+ *     a multiple of align bytes. The free block found has room for
+ *     a leading free block of at least MIN_BLOCK_SIZE bytes in front
+ *     of the aligned one, which is split off and indexed, and
+ *     set_allocated gives back the trailing slack.
+ */
+static void *heap_memalign(arena *a, size_t align, size_t size)
+{
+	size_t newsize, lead, flags;
+	char *bp, *aligned, *start;
+
+	newsize = ALIGN(size + WSIZE);
+	if (newsize < MIN_BLOCK_SIZE)
+		newsize = MIN_BLOCK_SIZE;
+
+	bp = find_fit(a, newsize + align + MIN_BLOCK_SIZE);
+	if (bp == NULL && a->quick_cached != 0) {
+		quick_flush_all(a);
+		bp = find_fit(a, newsize + align + MIN_BLOCK_SIZE);
+	}
+	if (bp == NULL)
+		bp = extend(a, newsize + align + MIN_BLOCK_SIZE);
+	if (bp == NULL)
+		return NULL;
+	remove_free(a, bp);
+
+	//too small a gap for a free block takes the next aligned address
+	aligned = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+	if (aligned != bp && (size_t)(aligned - bp) < MIN_BLOCK_SIZE)
+		aligned += align;
+	lead = aligned - bp;
+
+	if (lead != 0) {
+		//the words where the two blocks meet may lie on purged pages
+		flags = GET(HDRP(bp)) & (PURGED_BIT | FRESH_BIT);
+		if (flags & PURGED_BIT) {
+			start = ADDRESS_PAGE_START(aligned - 2*WSIZE);
+			arena_recommit(a, start, PAGE_ALIGN((size_t)(aligned + sizeof(unalloc_bp) - start)));
+		}
+		a->splits++;
+		PUT(HDRP(aligned), PACK(GET_SIZE(HDRP(bp)) - lead, flags));
+		PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp)) | flags));
+		PUT(FTRP(bp), lead);
+		insert_free(a, bp);
+	}
+
+	set_allocated(a, aligned, newsize);
+	return aligned;
+}
+
+/*
+ * find_fit - a free block of at least size bytes, or NULL. Size's own
+ *     bin is tried first so that an exact fit is not passed over by the
+ *     rounding in mapping_search: the head of a list, or the best fit
+ *     in a tree. A tree bin found past it gives up its smallest block.
+ */
+static void *find_fit(arena *a, size_t size)
+{
+	int fl, sl;
+	unsigned int sl_map;
+	unsigned long fl_map;
+	void *bp;
+
+	a->searches++;
+	a->search_steps++;
+	mapping_insert(size, &fl, &sl);
+	if (BIN_IS_TREE(a, fl)) {
+		if ((bp = tree_find(a->free_trees[fl][sl], size, &a->search_steps)) != NULL)
+			return bp;
+	} else if (a->free_lists[fl][sl] != NULL && GET_SIZE(HDRP(a->free_lists[fl][sl])) >= size)
+		return a->free_lists[fl][sl];
+
+	mapping_search(size, &fl, &sl);
+	if (fl >= FL_INDEX_COUNT)
+		return NULL;
+
+	sl_map = a->sl_bitmap[fl] & (~0U << sl);
+	if (!sl_map) {
+		//no bin on this level, so take the first non-empty larger level
+		fl_map = a->fl_bitmap & (~0UL << (fl + 1));
+		if (!fl_map)
+			return NULL;
+		fl = __builtin_ctzl(fl_map);
+		sl_map = a->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(sl_map);
+
+	a->search_steps++;
+	if (BIN_IS_TREE(a, fl))
+		return tree_find(a->free_trees[fl][sl], 0, &a->search_steps);
+	return a->free_lists[fl][sl];
+}
+
+/*
+ * tree_insert - put free block bp into the size tree at root, below the
+ *     first node on its search path with a higher priority; what hung
+ *     there is split by key into bp's subtrees
+ */
+static void tree_insert(tree_bp **root, void *bp)
+{
+	tree_bp *node = (tree_bp *)bp, **link = root, **left, **right, *t;
+	uintptr_t priority = TREE_PRIORITY(node);
+
+	while (*link != NULL && TREE_PRIORITY(*link) > priority)
+		link = TREE_BEFORE(node, *link) ? &(*link)->left : &(*link)->right;
+
+	t = *link;
+	left = &node->left;
+	right = &node->right;
+	while (t != NULL) {
+		if (TREE_BEFORE(t, node)) {
+			*left = t;
+			left = &t->right;
+			t = t->right;
+		} else {
+			*right = t;
+			right = &t->left;
+			t = t->left;
+		}
+	}
+	*left = *right = NULL;
+	*link = node;
+}
+
+/*
+ * tree_remove - take free block bp out of the size tree at root,
+ *     merging its subtrees into its place by priority
+ */
+static void tree_remove(tree_bp **root, void *bp)
+{
+	tree_bp **link = root, *left, *right;
+
+	while (*link != bp)
+		link = TREE_BEFORE(bp, *link) ? &(*link)->left : &(*link)->right;
+
+	left = ((tree_bp *)bp)->left;
+	right = ((tree_bp *)bp)->right;
+	while (left != NULL && right != NULL) {
+		if (TREE_PRIORITY(left) > TREE_PRIORITY(right)) {
+			*link = left;
+			link = &left->right;
+			left = left->right;
+		} else {
+			*link = right;
+			link = &right->left;
+			right = right->left;
+		}
+	}
+	*link = left != NULL ? left : right;
+}
+
+/*
+ * tree_find - the smallest block of at least size bytes in the size
+ *     tree at root, the lowest one of those, or NULL; the nodes looked
+ *     at are added to steps
+ */
+static void *tree_find(tree_bp *root, size_t size, unsigned long *steps)
+{
+	tree_bp *best = NULL;
+
+	while (root != NULL) {
+		(*steps)++;
+		if (GET_SIZE(HDRP(root)) >= size) {
+			best = root;
+			root = root->left;
+		} else
+			root = root->right;
+	}
+	return best;
+}
+
+/*
+ * insert_free - push a free block onto the head of its bin, or put it
+ *     in its bin's size tree
+ */
+static void insert_free(arena *a, void *bp)
+{
+	int fl, sl;
+	unalloc_bp *node = (unalloc_bp *)bp;
+
+	mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+	if (BIN_IS_TREE(a, fl))
+		tree_insert(&a->free_trees[fl][sl], bp);
+	else {
+		node->prev = NULL;
+		node->next = a->free_lists[fl][sl];
+		if (node->next != NULL)
+			node->next->prev = node;
+		a->free_lists[fl][sl] = node;
+	}
+
+	a->fl_bitmap |= 1UL << fl;
+	a->sl_bitmap[fl] |= 1U << sl;
+}
+
+/*
+ * remove_free - unlink a free block from its bin or take it out of its
+ *     bin's size tree
+ */
+static void remove_free(arena *a, void *bp)
+{
+	int fl, sl;
+	unalloc_bp *node = (unalloc_bp *)bp;
+
+	mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+	if (BIN_IS_TREE(a, fl)) {
+		tree_remove(&a->free_trees[fl][sl], bp);
+		if (a->free_trees[fl][sl] != NULL)
+			return;
+	} else {
+		if (node->prev != NULL)
+			node->prev->next = node->next;
+		else
+			a->free_lists[fl][sl] = node->next;
+		if (node->next != NULL)
+			node->next->prev = node->prev;
+		if (a->free_lists[fl][sl] != NULL)
+			return;
+	}
+
+	a->sl_bitmap[fl] &= ~(1U << sl);
+	if (!a->sl_bitmap[fl])
+		a->fl_bitmap &= ~(1UL << fl);
+}
+
+/*
+*  extend - finds room for a free block of size bytes outside the
+*           chunks and returns that block, already in the free index:
+*           a chunk grows up into a free span right above it, or a
+*           new chunk starts in a free span, mapping one if need be
+*/
+
+void *extend(arena *a, size_t size)
+{
+	size_t chunk_size = PAGE_ALIGN(size + CHUNK_OVERHEAD);
+	size_t grow;
+	span *s;
+
+	a->extends++;
+	a->span_clock++;
+	if (a->retained != 0)
+		span_trim(a);
+
+	//the newest chunk grows into what is left of its mapping first
+	s = a->last_span;
+	if (s != NULL && SPAN_ABOVE_CHUNK(s) && (grow = grow_size(s->prev, size)) != 0)
+		return grow_chunk(a, s->prev, grow);
+
+	s = span_find(a, PAGE_ALIGN(size));
+	if (s != NULL && SPAN_ABOVE_CHUNK(s) && (grow = grow_size(s->prev, size)) != 0) {
+		if (s->free == SPAN_RETAINED)
+			a->retain_hits++;
+		return grow_chunk(a, s->prev, grow);
+	}
+	if (s == NULL || s->size < chunk_size)
+		s = span_find(a, chunk_size);
+	if (s != NULL && s->free == SPAN_RETAINED)
+		a->retain_hits++;
+	else if (s == NULL) {
+		if (a->chunk_count != 0)
+			a->retain_misses++;
+		if ((s = span_new(a, SPAN_GROW * chunk_size)) == NULL)
+			return NULL;
+	}
+	return new_chunk(a, s, chunk_size);
+}
+
+/*
+ * grow_size - bytes chunk c takes from the free span above it to make
+ *     a free block of size bytes, counting the free last block they
+ *     merge with; 0 if the span is too small or the chunk would grow
+ *     past its limit
+ */
+static size_t grow_size(span *c, size_t size)
+{
+	char *epilogue = CHUNK_EPILOGUE(c);
+	size_t need = PAGE_ALIGN(size), last;
+
+	if (!GET_PREV_ALLOC(epilogue)) {
+		last = GET_SIZE(epilogue - WSIZE);
+		need = last < size ? PAGE_ALIGN(size - last) : APAGE_SIZE;
+	}
+	return need <= c->next->size && c->size + need <= c->limit ? need : 0;
+}
+
+/*
+ * span_link - put span s on the span list after prev, or first when
+ *     prev is NULL
+ */
+static void span_link(arena *a, span *s, span *prev)
 {
-  return 1;
+	s->prev = prev;
+	s->next = prev != NULL ? prev->next : a->first_span;
+	if (s->next != NULL)
+		s->next->prev = s;
+	else
+		a->last_span = s;
+	if (prev != NULL)
+		prev->next = s;
+	else
+		a->first_span = s;
+}
+
+/*
+ * span_unlink - take span s off the span list
+ */
+static void span_unlink(arena *a, span *s)
+{
+	if (s->prev != NULL)
+		s->prev->next = s->next;
+	else
+		a->first_span = s->next;
+	if (s->next != NULL)
+		s->next->prev = s->prev;
+	else
+		a->last_span = s->prev;
+}
+
+/*
+ * span_index - mark span s free and push it onto the list for its size
+ */
+static void span_index(arena *a, span *s)
+{
+	int i = SPAN_LIST(s->size);
+
+	s->free = SPAN_FREE;
+	s->free_prev = NULL;
+	s->free_next = a->span_free[i];
+	if (s->free_next != NULL)
+		s->free_next->free_prev = s;
+	a->span_free[i] = s;
+	a->span_bitmap |= 1UL << i;
+}
+
+/*
+ * span_unindex - take free span s off its list and mark it in use
+ */
+static void span_unindex(arena *a, span *s)
+{
+	int i = SPAN_LIST(s->size);
+
+	if (s->free_prev != NULL)
+		s->free_prev->free_next = s->free_next;
+	else
+		a->span_free[i] = s->free_next;
+	if (s->free_next != NULL)
+		s->free_next->free_prev = s->free_prev;
+	if (a->span_free[i] == NULL)
+		a->span_bitmap &= ~(1UL << i);
+	if (s->free == SPAN_RETAINED) {
+		if (s->retained_prev != NULL)
+			s->retained_prev->retained_next = s->retained_next;
+		else
+			a->retained_oldest = s->retained_next;
+		if (s->retained_next != NULL)
+			s->retained_next->retained_prev = s->retained_prev;
+		else
+			a->retained_newest = s->retained_prev;
+		a->retained -= s->size;
+	}
+	s->free = SPAN_IN_USE;
+}
+
+/*
+ * span_find - a free span of at least size bytes, or NULL: the head of
+ *     the first non-empty list that fits, or the first fit on the list
+ *     of the largest spans
+ */
+static span *span_find(arena *a, size_t size)
+{
+	unsigned long map = a->span_bitmap & (~0UL << SPAN_LIST(size));
+	span *s;
+
+	if (!map)
+		return NULL;
+	for (s = a->span_free[__builtin_ctzl(map)]; s != NULL; s = s->free_next) {
+		if (s->size >= size)
+			return s;
+	}
+	return NULL;
+}
+
+/*
+ * span_coalesce - merge free span s, not yet on a size list, with the
+ *     free spans it touches on either side in the span list, and index
+ *     the result
+ */
+static span *span_coalesce(arena *a, span *s)
+{
+	span *prev = s->prev, *next = s->next;
+
+	//a descriptor that ends up inside a fresh span is wiped
+	if (prev != NULL && prev->free && SPAN_END(prev) == SPAN_START(s)) {
+		span_unindex(a, prev);
+		span_unlink(a, prev);
+		s->size += prev->size;
+		s->fresh = s->fresh && prev->fresh;
+		if (s->fresh)
+			memset(prev, 0, SPAN_BYTES);
+	}
+	if (next != NULL && next->free && SPAN_END(s) == SPAN_START(next)) {
+		span_unindex(a, next);
+		span_unlink(a, s);
+		next->size += s->size;
+		next->fresh = next->fresh && s->fresh;
+		if (next->fresh)
+			memset(s, 0, SPAN_BYTES);
+		s = next;
+	}
+	span_index(a, s);
+	return s;
+}
+
+/*
+ * span_decommit - decommit the huge pages that lie wholly in free span
+ *     s and meet the bytes from start to end, except the one holding
+ *     its descriptor. Huge pages s shares with its neighbours stay
+ *     committed, as decommitting part of one splits it into small pages.
+ */
+static void span_decommit(arena *a, span *s, char *start, char *end)
+{
+	size_t unit = mem_mapunit();
+	char *lo = (char *)(((size_t)SPAN_START(s) + unit - 1) & ~(unit - 1));
+	char *hi = (char *)((size_t)(SPAN_END(s) - APAGE_SIZE) & ~(unit - 1));
+
+	start = (char *)((size_t)start & ~(unit - 1));
+	end = (char *)(((size_t)end + unit - 1) & ~(unit - 1));
+	if (start > lo)
+		lo = start;
+	if (end < hi)
+		hi = end;
+	if (lo < hi)
+		arena_decommit(a, lo, hi - lo);
+}
+
+/*
+ * span_new - map size bytes for arena a as a free span. It goes in
+ *     front of the last span when the mapping ends where that span
+ *     starts, as mappings made one after another often do, so the two
+ *     can merge or the chunk can grow into it, and behind it otherwise.
+ *     When memlib maps huge pages and the heap has reached HUGE_HEAP_MIN
+ *     bytes, the span is rounded up to whole huge pages, and all but
+ *     the one holding the descriptor start out decommitted, to be
+ *     counted only as chunks take them.
+ */
+static span *span_new(arena *a, size_t size)
+{
+	size_t unit = mem_mapunit();
+	char *mem;
+	span *s;
+
+	if (unit != APAGE_SIZE && a->heap_size + size < HUGE_HEAP_MIN)
+		unit = APAGE_SIZE;
+	size = (size + unit - 1) & ~(unit - 1);
+	mem = arena_map(a, size);
+	if (mem == NULL)
+		return NULL;
+	s = (span *)(mem + size - SPAN_BYTES);
+	s->size = size;
+	if (unit != APAGE_SIZE) {
+		a->huge_spans++;
+		span_decommit(a, s, mem, mem + size);
+	}
+	s->arena = a;
+	s->fresh = 1;
+	if (a->last_span != NULL && SPAN_END(s) == SPAN_START(a->last_span))
+		span_link(a, s, a->last_span->prev);
+	else
+		span_link(a, s, a->last_span);
+	return span_coalesce(a, s);
+}
+
+/*
+ * span_split - split the bottom size bytes off free span s as a span
+ *     in use with a descriptor of its own, linked in front of s, which
+ *     keeps the rest and stays free; if that uses all of s, s itself
+ *     is taken
+ */
+static span *span_split(arena *a, span *s, size_t size)
+{
+	span *bottom;
+
+	span_unindex(a, s);
+	if (s->size == size)
+		return s;
+	bottom = (span *)(SPAN_START(s) + size - SPAN_BYTES);
+	bottom->size = size;
+	bottom->arena = a;
+	bottom->free = SPAN_IN_USE;
+	bottom->fresh = s->fresh;
+	span_link(a, bottom, s->prev);
+	s->size -= size;
+	span_index(a, s);
+	return bottom;
+}
+
+/*
+ * span_release - unmap free span s
+ */
+static void span_release(arena *a, span *s)
+{
+	span_unindex(a, s);
+	span_unlink(a, s);
+	arena_unmap(a, SPAN_START(s), s->size);
+}
+
+/*
+ * span_trim - unmap the retained spans that have gone RETAIN_DECAY
+ *     span events without reuse, and then the oldest ones until the
+ *     arena retains no more than retain_limit bytes
+ */
+static void span_trim(arena *a)
+{
+	span *s;
+
+	while ((s = a->retained_oldest) != NULL) {
+		if (a->retained <= retain_limit && a->span_clock - s->retained_at < RETAIN_DECAY)
+			return;
+		a->retain_releases++;
+		span_release(a, s);
+	}
+}
+
+/*
+ * new_chunk - start a chunk in the bottom size bytes of free span s and
+ *     return its single free block, already in the free index
+ */
+static void *new_chunk(arena *a, span *s, size_t size)
+{
+	char *start = SPAN_START(s);
+	size_t fresh = s->fresh ? FRESH_BIT : 0;
+	unsigned long *starts = NULL;
+	void *bp;
+
+	//every page of the chunk leads back to its start
+	if (a->keep_starts && (starts = arena_map(a, STARTS_BYTES(SPAN_GROW * size))) == NULL)
+		return NULL;
+	if ((ARENA_COUNT > 1 || starts != NULL) && !registry_set_pages(start, size, REG_CHUNK_ENTRY(start, a))) {
+		if (starts != NULL)
+			arena_unmap(a, starts, STARTS_BYTES(SPAN_GROW * size));
+		return NULL;
+	}
+	arena_recommit(a, start, size);
+	s = span_split(a, s, size);
+	s->limit = SPAN_GROW * size;
+	s->starts = starts;
+	s->dirty = 1;
+	CHUNK_SPAN(start) = s;
+	a->chunk_count++;
+	if (CHUNK_REGISTERED(s))
+		a->chunk_pages += size / APAGE_SIZE;
+
+	//one free block spans the chunk; nothing precedes it
+	bp = CHUNK_FIRST_BP(s);
+	PUT(HDRP(bp), PACK(size - CHUNK_OVERHEAD, PREV_ALLOC_BIT | fresh));
+	PUT(FTRP(bp), size - CHUNK_OVERHEAD);
+
+	//set last node to 0 size and allocated
+	PUT(CHUNK_EPILOGUE(s), PACK(0, ALLOC_BIT));
+
+	insert_free(a, bp);
+	return bp;
+}
+
+/*
+ * grow_chunk - move the end of chunk c up over the bottom size bytes
+ *     of the free span right above it, and return the free block that
+ *     adds, merged with a free last block and already in the index
+ */
+static void *grow_chunk(arena *a, span *c, size_t size)
+{
+	char *start = SPAN_START(c);
+	span *moved = (span *)((char *)c + size), *s = c->next;
+	size_t fresh = s->fresh ? FRESH_BIT : 0;
+	void *bp = c;
+
+	if (CHUNK_REGISTERED(c) && !registry_set_pages(SPAN_END(c), size, REG_CHUNK_ENTRY(start, a)))
+		return NULL;
+	arena_recommit(a, SPAN_END(c), size);
+	span_unindex(a, s);
+	if (s->size > size) {
+		s->size -= size;
+		span_index(a, s);
+	} else
+		span_unlink(a, s);
+
+	//the descriptor moves to the new end of the chunk
+	*moved = *c;
+	moved->size += size;
+	moved->dirty = 1;
+	if (moved->prev != NULL)
+		moved->prev->next = moved;
+	else
+		a->first_span = moved;
+	if (moved->next != NULL)
+		moved->next->prev = moved;
+	else
+		a->last_span = moved;
+	CHUNK_SPAN(start) = moved;
+	if (CHUNK_REGISTERED(moved))
+		a->chunk_pages += size / APAGE_SIZE;
+
+	//the old epilogue heads the new block, whose only other leftover
+	//is the old descriptor
+	if (fresh)
+		memset(c, 0, SPAN_BYTES);
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | fresh));
+	PUT(FTRP(bp), size);
+	PUT(CHUNK_EPILOGUE(moved), PACK(0, ALLOC_BIT));
+	bp = coalesce(a, bp);
+	insert_free(a, bp);
+	return bp;
+}
+
+/*
+ * free_chunk - turn an empty chunk back into a free span, merged with
+ *     the free spans it touches, and retain that for reuse, unmapping
+ *     whatever the retain limit no longer allows
+ */
+static void free_chunk(arena *a, span *c)
+{
+	char *start = SPAN_START(c), *end = SPAN_END(c);
+	span *s;
+
+	a->chunk_releases++;
+	a->chunk_count--;
+	if (CHUNK_REGISTERED(c)) {
+		a->chunk_pages -= c->size / APAGE_SIZE;
+		registry_set_pages(SPAN_START(c), c->size, NULL);
+	}
+	if (c->starts != NULL) {
+		arena_unmap(a, c->starts, STARTS_BYTES(c->limit));
+		c->starts = NULL;
+	}
+	c->fresh = 0;
+	s = span_coalesce(a, c);
+
+	//free spans of huge pages only count the huge pages they share
+	//and the one holding their descriptor
+	if (a->huge_spans != 0)
+		span_decommit(a, s, start, end);
+	s->free = SPAN_RETAINED;
+	s->retained_at = ++a->span_clock;
+	s->retained_next = NULL;
+	s->retained_prev = a->retained_newest;
+	if (a->retained_newest != NULL)
+		a->retained_newest->retained_next = s;
+	else
+		a->retained_oldest = s;
+	a->retained_newest = s;
+	a->retained += s->size;
+	span_trim(a);
+}
+
+/*
+ * chunk_mark - set the start bit of block bp when it is handed out, or
+ *     clear it when used is 0 and the block is no longer in use, and
+ *     mark its chunk dirty; only once the arena keeps start bitmaps
+ */
+static void chunk_mark(arena *a, void *bp, int used)
+{
+	span *s;
+	size_t bit;
+
+	if (!a->keep_starts)
+		return;
+	s = CHUNK_SPAN(REG_CHUNK_START(registry_get(bp)));
+	s->dirty = 1;
+	bit = START_BIT(s, bp);
+	if (used)
+		s->starts[bit / 64] |= 1UL << (bit % 64);
+	else
+		s->starts[bit / 64] &= ~(1UL << (bit % 64));
+}
+
+/*
+ * chunk_keep_starts - give chunk s a start bitmap, registering its
+ *     pages if it has none yet, and fill it in from its blocks; 0 if
+ *     the memory for either could not be had
+ */
+static int chunk_keep_starts(arena *a, span *s)
+{
+	char *start = SPAN_START(s), *bp;
+	size_t bit;
+
+	if (s->starts != NULL)
+		memset(s->starts, 0, STARTS_BYTES(s->limit));
+	else {
+		if (ARENA_COUNT == 1 && !registry_set_pages(start, s->size, REG_CHUNK_ENTRY(start, a)))
+			return 0;
+		if ((s->starts = arena_map(a, STARTS_BYTES(s->limit))) == NULL) {
+			if (ARENA_COUNT == 1)
+				registry_set_pages(start, s->size, NULL);
+			return 0;
+		}
+		if (ARENA_COUNT == 1)
+			a->chunk_pages += s->size / APAGE_SIZE;
+	}
+
+	//a cached block is already free; the next check walks the chunk
+	s->dirty = 1;
+	for (bp = CHUNK_FIRST_BP(s); HDRP(bp) != CHUNK_EPILOGUE(s); bp = NEXT_BLKP(bp))
+		if ((GET(HDRP(bp)) & (ALLOC_BIT | QUICK_BIT)) == ALLOC_BIT) {
+			bit = START_BIT(s, bp);
+			s->starts[bit / 64] |= 1UL << (bit % 64);
+		}
+	return 1;
+}
+
+/*
+ * arena_keep_starts - have every chunk of arena a keep a start bitmap
+ *     from now on, which mm_can_free asks for the first time it looks
+ *     at the arena; 0 if some chunk could not be given one
+ */
+static int arena_keep_starts(arena *a)
+{
+	span *s;
+
+	for (s = a->first_span; s != NULL; s = s->next)
+		if (!s->free && !chunk_keep_starts(a, s))
+			return 0;
+	a->keep_starts = 1;
+	return 1;
+}
+
+/*
+ * mm_free - Free a block, into this thread's cache when the
+ *     thread-safe build is freeing a slab slot, onto the remote list
+ *     of another thread's arena, and otherwise into this thread's
+ *     arena. Freeing NULL does nothing.
+ */
+void mm_free(void *ptr)
+{
+	void *entry;
+	arena *a;
+
+	if (ptr == NULL)
+		return;
+	if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) != 0)
+		sample_free(ptr);
+	entry = registry_get(ptr);
+#ifdef MM_THREADS
+	if (REG_KIND(entry) == REG_SLAB) {
+		tcache_free(((slab_page *)REG_OWNER(entry))->class, ptr);
+		return;
+	}
+#endif
+
+	a = entry_arena(entry);
+	if (a == NULL)
+		return;
+#ifdef MM_THREADS
+	if (!tregistered)
+		thread_register();
+#endif
+	tstats.frees[STATS_ENTRY_CLASS(entry)]++;
+#ifdef MM_THREADS
+	if (a != tarena && remote_free) {
+		remote_push(a, ptr);
+		return;
+	}
+#endif
+	arena_lock(a);
+	heap_free(entry, ptr);
+	arena_unlock(a);
+}
+
+/*
+ * mm_free_batch - Free n blocks. Slab slots and large blocks go where
+ *     mm_free would send them, while the chunk blocks are copied to a
+ *     buffer of their own, on the stack or mapped for a big batch, to
+ *     be sorted by address and released by free_sorted; ptrs itself is
+ *     left as it is. If no buffer can be mapped, the stack one is
+ *     released whenever it fills. The arena lock is held for as long
+ *     as the blocks come from the same arena. NULL entries are skipped,
+ *     as mm_free skips NULL.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+	arena *a, *locked = NULL;
+	void *entry, *stack[BATCH_SORT], **sorted = stack;
+	size_t i, m = 0, room = BATCH_SORT, bytes = 0;
+
+	if (n > BATCH_SORT) {
+		bytes = PAGE_ALIGN(n * sizeof(void *));
+		if ((sorted = arena_map(NULL, bytes)) != NULL)
+			room = n;
+		else {
+			sorted = stack;
+			bytes = 0;
+		}
+	}
+	if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) != 0)
+		for (i = 0; i < n; i++)
+			sample_free(ptrs[i]);
+	for (i = 0; i < n; i++) {
+		if (ptrs[i] == NULL)
+			continue;
+		entry = registry_get(ptrs[i]);
+#ifdef MM_THREADS
+		if (REG_KIND(entry) == REG_SLAB) {
+			//the thread cache may need the slab's arena lock
+			if (locked != NULL) {
+				arena_unlock(locked);
+				locked = NULL;
+			}
+			tcache_free(((slab_page *)REG_OWNER(entry))->class, ptrs[i]);
+			continue;
+		}
+#endif
+		a = entry_arena(entry);
+		if (a == NULL)
+			continue;
+#ifdef MM_THREADS
+		if (!tregistered)
+			thread_register();
+#endif
+		tstats.frees[STATS_ENTRY_CLASS(entry)]++;
+#ifdef MM_THREADS
+		if (a != tarena && remote_free) {
+			remote_push(a, ptrs[i]);
+			continue;
+		}
+#endif
+		if (REG_KIND(entry) != REG_SLAB && REG_KIND(entry) != REG_LARGE) {
+			sorted[m++] = ptrs[i];
+			if (m == room) {
+				free_sorted(sorted, m, &locked);
+				m = 0;
+			}
+			continue;
+		}
+		if (a != locked) {
+			if (locked != NULL)
+				arena_unlock(locked);
+			arena_lock(a);
+			locked = a;
+		}
+		heap_free(entry, ptrs[i]);
+	}
+
+	free_sorted(sorted, m, &locked);
+	if (locked != NULL)
+		arena_unlock(locked);
+	if (bytes != 0)
+		arena_unmap(NULL, sorted, bytes);
+}
+
+/*
+ * free_sorted - Sort m chunk blocks by address and free them, each
+ *     under its arena's lock, which is left held in *locked. A run of
+ *     more neighbouring blocks than a quick list holds is released as
+ *     one block.
+ */
+static void free_sorted(void **ptrs, size_t m, arena **locked)
+{
+	arena *a;
+	char *bp;
+	size_t i, j, size;
+
+	qsort(ptrs, m, sizeof(void *), ptr_order);
+	for (i = 0; i < m; i = j) {
+		a = entry_arena(registry_get(ptrs[i]));
+		if (a != *locked) {
+			if (*locked != NULL)
+				arena_unlock(*locked);
+			arena_lock(a);
+			*locked = a;
+		}
+
+		//gather the allocated blocks that follow this one
+		bp = ptrs[i];
+		size = GET_SIZE(HDRP(bp));
+		j = i + 1;
+		if (GET(HDRP(bp)) & QUICK_BIT)
+			continue;
+		while (j < m && ptrs[j] == bp + size
+		       && (GET(HDRP(ptrs[j])) & (ALLOC_BIT | QUICK_BIT)) == ALLOC_BIT) {
+			size += GET_SIZE(HDRP(ptrs[j]));
+			chunk_mark(a, ptrs[j], 0);
+			j++;
+		}
+
+		//a short run goes the way of single frees, which caches it
+		if (j - i > QUICK_COUNT) {
+			a->coalesces += j - i - 1;
+			PUT(HDRP(bp), PACK(size, ALLOC_BIT | GET_PREV_ALLOC(HDRP(bp))));
+			release_block(a, bp);
+		} else
+			for (; i < j; i++)
+				free_block(a, ptrs[i]);
+	}
+}
+
+/*
+ * ptr_order - qsort order of two block pointers, by address
+ */
+static int ptr_order(const void *p, const void *q)
+{
+	uintptr_t x = (uintptr_t)*(void * const *)p, y = (uintptr_t)*(void * const *)q;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * mm_free_sized - Free a block given the size it was last requested
+ *     with, or any size from there up to its usable size, or 0 for
+ *     unknown. A block that the registry says is a slab slot is freed
+ *     straight into its slab or the thread's cache; anything else,
+ *     such as a small block from mm_memalign, goes to mm_free.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+	slab_page *slab;
+	unsigned int class;
+	void *entry;
+#ifndef MM_THREADS
+	arena *a;
+#endif
+
+	if (ptr == NULL)
+		return;
+	entry = size != 0 && size <= SLAB_MAX_SIZE ? registry_get(ptr) : NULL;
+	if (REG_KIND(entry) != REG_SLAB) {
+		mm_free(ptr);
+		return;
+	}
+	if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) != 0)
+		sample_free(ptr);
+
+	//slab_free may unmap the slab, so read what is needed first
+	slab = REG_OWNER(entry);
+	class = slab->class;
+#ifdef MM_THREADS
+	tcache_free(class, ptr);
+#else
+	a = slab->arena;
+	arena_lock(a);
+	slab_free(slab, ptr);
+	arena_unlock(a);
+	tstats.frees[class]++;
+#endif
+}
+
+/*
+ * heap_free - Hand a block back to the slab page, mapping or chunk
+ *     its registry entry says it came from.
+ */
+static void heap_free(void *entry, void *ptr)
+{
+	if (REG_KIND(entry) == REG_SLAB)
+		slab_free(REG_OWNER(entry), ptr);
+	else if (REG_KIND(entry) == REG_LARGE)
+		large_free(REG_OWNER(entry));
+	else
+		free_block(entry_arena(entry), ptr);
+}
+
+/*
+ * free_block - Cache an allocated chunk block on the quick list for
+ *     its size, coalescing that list into the heap first when it is
+ *     full; blocks too big for a quick list are released right away.
+ *     A block that is already cached is left alone.
+ */
+static void free_block(arena *a, void *ptr)
+{
+	size_t size = GET_SIZE(HDRP(ptr));
+	int list = QUICK_LIST(size);
+	char *first, *next;
+
+	if (GET(HDRP(ptr)) & QUICK_BIT)
+		return;
+
+	//nothing cached has been reused for a while: let it all go
+	if (a->quick_cached != 0 && ++a->quick_idle == QUICK_DECAY)
+		quick_flush_all(a);
+	if (size > QUICK_MAX_SIZE) {
+		release_block(a, ptr);
+		return;
+	}
+
+	//the last block in use in a chunk is not cached, so the cache
+	//never keeps an otherwise empty chunk from being released
+	first = GET_PREV_ALLOC(HDRP(ptr)) ? ptr : PREV_BLKP(ptr);
+	next = NEXT_BLKP(ptr);
+	if (!GET_ALLOC(HDRP(next)))
+		next = NEXT_BLKP(next);
+	if (GET_SIZE(HDRP(next)) == 0 && first == CHUNK_FIRST_BP(EPILOGUE_SPAN(HDRP(next)))) {
+		release_block(a, ptr);
+		return;
+	}
+
+	if (a->quick_count[list] == QUICK_COUNT)
+		quick_flush(a, list);
+	PUT(HDRP(ptr), GET(HDRP(ptr)) | QUICK_BIT);
+	chunk_mark(a, ptr, 0);
+	QUICK_NEXT(ptr) = a->quick[list];
+	a->quick[list] = ptr;
+	a->quick_count[list]++;
+	a->quick_cached++;
+}
+
+/*
+ * quick_flush - Release every block cached on one quick list.
+ */
+static void quick_flush(arena *a, int list)
+{
+	void *bp;
+
+	while ((bp = a->quick[list]) != NULL) {
+		a->quick[list] = QUICK_NEXT(bp);
+		a->quick_count[list]--;
+		a->quick_cached--;
+		PUT(HDRP(bp), GET(HDRP(bp)) & ~(size_t)QUICK_BIT);
+		release_block(a, bp);
+	}
+}
+
+/*
+ * quick_flush_all - Release every block cached on the quick lists.
+ */
+static void quick_flush_all(arena *a)
+{
+	int list;
+
+	for (list = 0; list < QUICK_LISTS && a->quick_cached != 0; list++)
+		if (a->quick[list] != NULL)
+			quick_flush(a, list);
+	a->quick_idle = 0;
+}
+
+/*
+ * release_block - Coalesce an allocated chunk block with its free
+ *     neighbours and index the result, releasing an emptied chunk.
+ */
+static void release_block(arena *a, void *ptr)
+{
+	size_t size = GET_SIZE(HDRP(ptr));
+
+	chunk_mark(a, ptr, 0);
+	PUT(HDRP(ptr), PACK(size, GET_PREV_ALLOC(HDRP(ptr))));
+	PUT(FTRP(ptr), size);
+	CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+	void *p = coalesce(a, ptr);
+
+	//the chunk is empty when its first block runs up to the epilogue
+	char *next = HDRP(NEXT_BLKP(p));
+	if(a->chunk_count > 1 && GET_SIZE(next) == 0 && p == CHUNK_FIRST_BP(EPILOGUE_SPAN(next)))
+	{
+		free_chunk(a, EPILOGUE_SPAN(next));
+		return;
+	}
+
+	//a big block gives its pages back; once it has, only the pages
+	//around the block just freed are new
+	if (purge_bytes != 0 && GET_SIZE(HDRP(p)) >= purge_bytes) {
+		if (GET(HDRP(p)) & PURGED_BIT)
+			purge_block(a, p, ADDRESS_PAGE_START(HDRP(ptr) - WSIZE),
+				    (char *)ptr + size + sizeof(unalloc_bp) + APAGE_SIZE);
+		else
+			purge_block(a, p, p, next);
+	}
+
+	insert_free(a, p);
+}
+
+/*
+ * mm_realloc - Resize a block in place when possible: a chunk block
+ *     shrinks by splitting off its tail and grows by absorbing a free
+ *     successor, a slab slot stays put within its class, and a large
+ *     block stays in its mapping while it fills most of it. Only
+ *     otherwise is the data moved to a new block.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+	void *entry, *newp;
+	arena *a;
+	int class;
+
+	if (ptr == NULL)
+		return mm_malloc(size);
+	if (size == 0) {
+		mm_free(ptr);
+		return NULL;
+	}
+	if (size > MAX_REQUEST)
+		return NULL;
+
+	//a slot that keeps its class needs neither a lock nor the heap
+	entry = registry_get(ptr);
+	if (REG_KIND(entry) == REG_SLAB && size <= SLAB_MAX_SIZE
+	    && SLAB_CLASS(size) == ((slab_page *)REG_OWNER(entry))->class)
+		return ptr;
+
+	a = entry_arena(entry);
+	if (a == NULL)
+		return NULL;
+	//a sampled block is dropped and the one it becomes counted afresh
+	if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) != 0)
+		sample_free(ptr);
+	//the old block's slab page may be gone once it has moved
+	class = STATS_ENTRY_CLASS(entry);
+	arena_lock(a);
+	newp = heap_realloc(a, entry, ptr, size);
+	arena_unlock(a);
+	//a block that moved counts as freed and allocated again
+	if (newp != NULL && newp != ptr) {
+#ifdef MM_THREADS
+		if (!tregistered)
+			thread_register();
+#endif
+		tstats.frees[class]++;
+		tstats.mallocs[STATS_CLASS(size)]++;
+	}
+	if (SAMPLE_DUE(size))
+		sample_alloc(newp, size);
+	return newp;
+}
+
+/*
+ * heap_realloc - mm_realloc for a block that may have to change
+ *     blocks; entry is ptr's registry entry and a the arena that
+ *     owns it, which also gets any new block
+ */
+static void *heap_realloc(arena *a, void *entry, void *ptr, size_t size)
+{
+	size_t newsize, oldsize, extra_size;
+	large_header *large;
+	void *next, *newp;
+
+	if (REG_KIND(entry) == REG_SLAB) {
+		oldsize = SLAB_SLOT_SIZE(((slab_page *)REG_OWNER(entry))->class);
+	} else if (REG_KIND(entry) == REG_LARGE) {
+		//stay in the mapping while the block still uses most of it
+		large = REG_OWNER(entry);
+		oldsize = large->length - sizeof(large_header);
+		if (size <= oldsize && size >= MMAP_THRESHOLD && LARGE_CACHE_FIT(size + sizeof(large_header), large->length))
+			return ptr;
+	} else {
+		newsize = ALIGN(size + WSIZE);
+		if (newsize < MIN_BLOCK_SIZE)
+			newsize = MIN_BLOCK_SIZE;
+		oldsize = GET_SIZE(HDRP(ptr));
+
+		//absorb a free successor, then give back whatever is left over;
+		//a block shrinking to a slab size moves into a slot instead
+		next = NEXT_BLKP(ptr);
+		if (size > SLAB_MAX_SIZE && newsize > oldsize && !GET_ALLOC(HDRP(next)) && oldsize + GET_SIZE(HDRP(next)) >= newsize) {
+			remove_free(a, next);
+			oldsize += GET_SIZE(HDRP(next));
+			PUT(HDRP(ptr), PACK(oldsize, GET_PREV_ALLOC(HDRP(ptr)) | (GET(HDRP(next)) & PURGED_BIT)));
+			set_allocated(a, ptr, newsize);
+			return ptr;
+		}
+
+		if (size > SLAB_MAX_SIZE && newsize <= oldsize) {
+			extra_size = oldsize - newsize;
+			if (extra_size >= MIN_BLOCK_SIZE) {
+				a->splits++;
+				PUT(HDRP(ptr), PACK(newsize, ALLOC_BIT | GET_PREV_ALLOC(HDRP(ptr))));
+				next = NEXT_BLKP(ptr);
+				PUT(HDRP(next), PACK(extra_size, ALLOC_BIT | PREV_ALLOC_BIT));
+				free_block(a, next);
+			}
+			return ptr;
+		}
+		oldsize -= WSIZE;
+	}
+
+	//last resort: move the payload to a new block
+	newp = heap_malloc(a, size, 0);
+	if (newp == NULL)
+		return NULL;
+	memcpy(newp, ptr, oldsize < size ? oldsize : size);
+	heap_free(entry, ptr);
+	return newp;
+}
+
+/*
+ * mm_usable_size - Bytes of ptr's block the caller may use, at least
+ *     the size it asked for; 0 for NULL or a block not the allocator's
+ */
+size_t mm_usable_size(void *ptr)
+{
+	void *entry;
+
+	if (ptr == NULL)
+		return 0;
+	entry = registry_get(ptr);
+	if (REG_KIND(entry) == REG_SLAB)
+		return SLAB_SLOT_SIZE(((slab_page *)REG_OWNER(entry))->class);
+	if (REG_KIND(entry) == REG_LARGE)
+		return ((large_header *)REG_OWNER(entry))->length - sizeof(large_header);
+	if (entry_arena(entry) == NULL)
+		return 0;
+	return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+ * mm_good_size - The usable size a request of size bytes gets at least,
+ *     so that a caller can ask for the slack it would get anyway; 0 for
+ *     a size that cannot be allocated
+ */
+size_t mm_good_size(size_t size)
+{
+	size_t newsize;
+
+	if (size == 0 || size > MAX_REQUEST)
+		return 0;
+	if (size <= SLAB_MAX_SIZE)
+		return SLAB_SLOT_SIZE(SLAB_CLASS(size));
+	if (size >= MMAP_THRESHOLD)
+		return PAGE_ALIGN(size + sizeof(large_header)) - sizeof(large_header);
+	newsize = ALIGN(size + WSIZE);
+	if (newsize < MIN_BLOCK_SIZE)
+		newsize = MIN_BLOCK_SIZE;
+	return newsize - WSIZE;
+}
+
+/*
+ * check_free_links - Check that a free block found by the heap walk is
+ *     linked into the bin its size maps to, or is found in its bin's
+ *     size tree by a search that gives up on any node out of order.
+ */
+static int check_free_links(arena *a, void *bp)
+{
+	int fl, sl;
+	unalloc_bp *node = (unalloc_bp *)bp;
+	tree_bp *t, *lo = NULL, *hi = NULL;
+
+	mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+	if (BIN_IS_TREE(a, fl)) {
+		for (t = a->free_trees[fl][sl]; t != bp; ) {
+			if (t == NULL || ((size_t)t % ALIGNMENT) != 0 || !ptr_is_mapped(HDRP(t), WSIZE + sizeof(tree_bp)))
+				return 0;
+			if ((lo != NULL && !TREE_BEFORE(lo, t)) || (hi != NULL && !TREE_BEFORE(t, hi)))
+				return 0;
+			if (TREE_BEFORE(bp, t)) {
+				hi = t;
+				t = t->left;
+			} else {
+				lo = t;
+				t = t->right;
+			}
+		}
+		return 1;
+	}
+
+	if (node->prev == NULL) {
+		if (a->free_lists[fl][sl] != node)
+			return 0;
+	} else {
+		if (!ptr_is_mapped(node->prev, sizeof(unalloc_bp)) || node->prev->next != node)
+			return 0;
+	}
+	if (node->next != NULL) {
+		if (!ptr_is_mapped(node->next, sizeof(unalloc_bp)) || node->next->prev != node)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * check_tree - Check the size tree below node: each node is a free
+ *     block of bin fl, sl that sorts between lo and hi (NULL for no
+ *     bound), with no higher a priority than its parent's. Nodes are
+ *     counted off *left, so that a cycle runs out of them and fails.
+ */
+static int check_tree(tree_bp *node, tree_bp *lo, tree_bp *hi, uintptr_t priority,
+		      int fl, int sl, int *left)
+{
+	int bin_fl, bin_sl;
+
+	if (node == NULL)
+		return 1;
+	if (--*left < 0)
+		return 0;
+	if (((size_t)node % ALIGNMENT) != 0 || !ptr_is_mapped(HDRP(node), WSIZE + sizeof(tree_bp)))
+		return 0;
+	if (GET_ALLOC(HDRP(node)) != 0 || TREE_PRIORITY(node) > priority)
+		return 0;
+	if ((lo != NULL && !TREE_BEFORE(lo, node)) || (hi != NULL && !TREE_BEFORE(node, hi)))
+		return 0;
+	mapping_insert(GET_SIZE(HDRP(node)), &bin_fl, &bin_sl);
+	if (bin_fl != fl || bin_sl != sl)
+		return 0;
+	return check_tree(node->left, lo, node, TREE_PRIORITY(node), fl, sl, left)
+	       && check_tree(node->right, node, hi, TREE_PRIORITY(node), fl, sl, left);
+}
+
+/*
+ * check_bitmaps - Make sure the TLSF bitmaps mark exactly the bins
+ *     that are not empty
+ */
+static int check_bitmaps(arena *a)
+{
+	int fl, sl, empty;
+
+	for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+		if (!!(a->fl_bitmap & (1UL << fl)) != !!a->sl_bitmap[fl])
+			return 0;
+		for (sl = 0; sl < SL_INDEX_COUNT; sl++) {
+			if (BIN_IS_TREE(a, fl))
+				empty = a->free_trees[fl][sl] == NULL;
+			else
+				empty = a->free_lists[fl][sl] == NULL;
+			if (!!(a->sl_bitmap[fl] & (1U << sl)) == empty)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * check_bins - Walk every TLSF bin and make sure the bitmaps, the
+ *     links and the block sizes agree, and that the bins hold exactly
+ *     the free_count free blocks found by the heap walk.
+ */
+static int check_bins(arena *a, int free_count)
+{
+	int fl, sl, bin_fl, bin_sl, left;
+	int seen = 0;
+	unalloc_bp *node, *prev;
+	tree_bp *root;
+
+	if (!check_bitmaps(a))
+		return 0;
+	for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+		for (sl = 0; sl < SL_INDEX_COUNT; sl++) {
+			if (BIN_IS_TREE(a, fl)) {
+				root = a->free_trees[fl][sl];
+				left = free_count - seen;
+				if (!check_tree(root, NULL, NULL, UINTPTR_MAX, fl, sl, &left))
+					return 0;
+				seen = free_count - left;
+				continue;
+			}
+			prev = NULL;
+			for (node = a->free_lists[fl][sl]; node != NULL; node = node->next) {
+				if (++seen > free_count)
+					return 0;
+				if (((size_t)node % ALIGNMENT) != 0)
+					return 0;
+				if (!ptr_is_mapped(HDRP(node), WSIZE))
+					return 0;
+				if (GET_ALLOC(HDRP(node)) != 0 || node->prev != prev)
+					return 0;
+				mapping_insert(GET_SIZE(HDRP(node)), &bin_fl, &bin_sl);
+				if (bin_fl != fl || bin_sl != sl)
+					return 0;
+				prev = node;
+			}
+		}
+	}
+	return seen == free_count;
+}
+
+/*
+ * mm_check - Check whether the heap is ok, so that mm_malloc()
+ *            and proper mm_free() calls won't crash. Every
+ *            check_full-th call walks the whole heap; the others only
+ *            walk the chunks that changed since the last check.
+ */
+int mm_check()
+{
+	int ok, i, full = check_calls++ % check_full == 0;
+
+	for (i = 0; i < ARENA_COUNT; i++)
+		arena_lock(&arenas[i]);
+
+	//only chunks with start bitmaps record that they changed, so an
+	//arena that just got them has all of its chunks walked
+	for (i = 0; i < ARENA_COUNT && check_full > 1; i++)
+		if (!arenas[i].keep_starts && !arena_keep_starts(&arenas[i]))
+			full = 1;
+	ok = check_heap(full);
+#ifdef MM_THREADS
+	ok = ok && check_tcache();
+#endif
+	for (i = 0; i < ARENA_COUNT; i++)
+		arena_unlock(&arenas[i]);
+	return ok;
+}
+
+/*
+ * check_heap - Check the registry, then drain every arena's remote
+ *     list, walk its chunks block by block and check its bins, slab
+ *     pages and large cache, and last the sampled blocks. Unless full
+ *     is set the registry, the bins and the samples are not walked, nor
+ *     are the chunks that did not change.
+ */
+static int check_heap(int full)
+{
+	size_t entries = 0;
+	int i;
+
+	for (i = 0; i < ARENA_COUNT; i++)
+		entries += arenas[i].slab_count + arenas[i].large_count + arenas[i].chunk_pages;
+	if (full && !check_registry(entries))
+		return 0;
+
+	for (i = 0; i < ARENA_COUNT; i++) {
+#ifdef MM_THREADS
+		if (!check_remote(&arenas[i]))
+			return 0;
+#endif
+		if (!check_chunks(&arenas[i], full) || !check_slabs(&arenas[i], full) || !check_large(&arenas[i]))
+			return 0;
+	}
+	return !full || check_samples();
+}
+
+/*
+ * check_span_lists - Walk every free span list and make sure the
+ *     bitmap, the links and the span sizes agree, that the lists hold
+ *     exactly the free_spans free spans found by the span walk, and
+ *     that the retained ones add up to the arena's retained bytes and
+ *     are all on the retained list, oldest first.
+ */
+static int check_span_lists(arena *a, int free_spans)
+{
+	int i, seen = 0, kept = 0;
+	size_t retained = 0;
+	span *s, *prev;
+
+	for (i = 0; i < SPAN_LISTS; i++) {
+		if (!!(a->span_bitmap & (1UL << i)) != (a->span_free[i] != NULL))
+			return 0;
+		prev = NULL;
+		for (s = a->span_free[i]; s != NULL; s = s->free_next) {
+			if (++seen > free_spans)
+				return 0;
+			if (SPAN_END(s) != ADDRESS_PAGE_START(SPAN_END(s)) || !ptr_is_mapped(s, sizeof(span)))
+				return 0;
+			if ((s->free != SPAN_FREE && s->free != SPAN_RETAINED) || s->arena != a
+			    || s->free_prev != prev || SPAN_LIST(s->size) != i)
+				return 0;
+			if (s->free == SPAN_RETAINED) {
+				retained += s->size;
+				kept++;
+			}
+			prev = s;
+		}
+	}
+	prev = NULL;
+	for (s = a->retained_oldest; s != NULL; s = s->retained_next) {
+		if (--kept < 0 || s->free != SPAN_RETAINED || s->arena != a || s->retained_prev != prev)
+			return 0;
+		if (prev != NULL && a->span_clock - s->retained_at > a->span_clock - prev->retained_at)
+			return 0;
+		prev = s;
+	}
+	return seen == free_spans && retained == a->retained && kept == 0 && a->retained_newest == prev;
+}
+
+/*
+ * check_chunks - Walk an arena's spans, and its chunks block by block,
+ *     then check its span lists and bins against the free spans and
+ *     free blocks found. Unless full is set only the dirty chunks are
+ *     walked, and the bins are only checked against their bitmaps and
+ *     the free blocks of those chunks; a walked chunk is clean again.
+ */
+static int check_chunks(arena *a, int full)
+{
+	void *bp;
+	char *epilogue, *p;
+	span *s = a->first_span, *prev_span = NULL;
+	int chunks = 0, free_spans = 0, free_count = 0, cached = 0;
+	size_t size, prev_alloc, pages = 0, spans = 0, starts, bit, i;
+
+	while(s!=NULL){
+		//every span is at least a page, so a longer list has a cycle
+		if (++spans > a->heap_size / APAGE_SIZE)
+			return 0;
+		if (SPAN_END(s) != ADDRESS_PAGE_START(SPAN_END(s)) || !ptr_is_mapped(s, sizeof(span)))
+			return 0;
+		if (s->prev != prev_span || s->arena != a || (s->free != SPAN_IN_USE && s->free != SPAN_FREE && s->free != SPAN_RETAINED) || s->size < APAGE_SIZE
+		    || s->size != PAGE_ALIGN(s->size))
+			return 0;
+		if ((full || s->free || s->dirty) && !ptr_is_mapped(SPAN_START(s), s->size))
+			return 0;
+
+		//free spans that touch are always merged
+		if (s->free) {
+			if (prev_span != NULL && prev_span->free && SPAN_END(prev_span) == SPAN_START(s))
+				return 0;
+			free_spans++;
+			prev_span = s;
+			s = s->next;
+			continue;
+		}
+		//a chunk only grows, up to SPAN_GROW times its first size
+		if (++chunks > a->chunk_count || s->size < PAGE_ALIGN(CHUNK_OVERHEAD + MIN_BLOCK_SIZE)
+		    || s->size > s->limit || s->limit / SPAN_GROW > s->size || s->limit % (SPAN_GROW * APAGE_SIZE) != 0
+		    || CHUNK_SPAN(SPAN_START(s)) != s)
+			return 0;
+
+		//a chunk that has not changed was fine when last walked
+		if (!full && !s->dirty) {
+			if (CHUNK_REGISTERED(s))
+				pages += s->size / APAGE_SIZE;
+			prev_span = s;
+			s = s->next;
+			continue;
+		}
+
+		//every page of the chunk must be registered to it
+		for (p = SPAN_START(s); CHUNK_REGISTERED(s) && p < (char *)s; p += APAGE_SIZE) {
+			if (registry_get(p) != REG_CHUNK_ENTRY(SPAN_START(s), a))
+				return 0;
+			pages++;
+		}
+
+		//a chunk has a start bitmap only once its arena keeps them, and
+		//then it has a bit set below the epilogue for each block in use
+		if (a->keep_starts ? s->starts == NULL || !ptr_is_mapped(s->starts, STARTS_BYTES(s->limit))
+		    : s->starts != NULL)
+			return 0;
+		epilogue = CHUNK_EPILOGUE(s);
+		starts = 0;
+		for (i = 0; a->keep_starts && i <= START_BIT(s, epilogue) / 64; i++)
+			starts += __builtin_popcountl(s->starts[i]);
+
+		bp = CHUNK_FIRST_BP(s);
+		prev_alloc = PREV_ALLOC_BIT;
+		while (HDRP(bp) != epilogue) {
+			size = GET_SIZE(HDRP(bp));
+			if (size < MIN_BLOCK_SIZE || size > (size_t)(epilogue - HDRP(bp)))
+				return 0;
+			if ((GET(HDRP(bp)) & FLAG_MASK & ~(size_t)(ALLOC_BIT | PREV_ALLOC_BIT | PURGED_BIT | QUICK_BIT)) != 0)
+				return 0;
+
+			//only a small allocated block can be cached
+			if (GET_ALLOC(HDRP(bp)) && (GET(HDRP(bp)) & QUICK_BIT)) {
+				if (size > QUICK_MAX_SIZE)
+					return 0;
+				cached++;
+			}
+
+			//and only a block in use has its start bit set
+			if (a->keep_starts) {
+				bit = START_BIT(s, bp);
+				if (STARTS_GET(s, bit) != ((GET(HDRP(bp)) & (ALLOC_BIT | QUICK_BIT)) == ALLOC_BIT))
+					return 0;
+				starts -= STARTS_GET(s, bit);
+			}
+
+			//only a purged free block may have decommitted pages, and
+			//not under its header, links or footer
+			if (!(GET(HDRP(bp)) & PURGED_BIT) || GET_ALLOC(HDRP(bp))) {
+				if (!range_committed(HDRP(bp), size))
+					return 0;
+			} else if (!range_committed(HDRP(bp), WSIZE + sizeof(unalloc_bp))
+				   || !range_committed(FTRP(bp), WSIZE))
+				return 0;
+
+			//the previous-allocated bit must match the block before
+			if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc)
+				return 0;
+
+			if (!GET_ALLOC(HDRP(bp))) {
+				//coalesce check
+				if (!prev_alloc)
+					return 0;
+				//Head and tail check
+				if (GET(FTRP(bp)) != size)
+					return 0;
+				if (!check_free_links(a, bp))
+					return 0;
+				free_count++;
+				prev_alloc = 0;
+			} else
+				prev_alloc = PREV_ALLOC_BIT;
+
+			bp = NEXT_BLKP(bp);
+		}
+
+		//the walk must end on the epilogue in front of the descriptor,
+		//having met every set start bit
+		if (GET(epilogue) != PACK(0, ALLOC_BIT | prev_alloc) || starts != 0)
+			return 0;
+
+		s->dirty = 0;
+		prev_span = s;
+		s = s->next;
+	}
+	if (prev_span != a->last_span || chunks != a->chunk_count || pages != a->chunk_pages)
+		return 0;
+
+	if (!full)
+		return check_span_lists(a, free_spans) && check_bitmaps(a) && check_quick(a, a->quick_cached);
+	return check_span_lists(a, free_spans) && check_bins(a, free_count) && check_quick(a, cached);
+}
+
+/*
+ * check_quick - Walk every quick list and make sure its blocks are
+ *     cached blocks of the list's size, that its count is right, and
+ *     that the lists hold exactly the cached blocks found by the walk.
+ */
+static int check_quick(arena *a, int cached)
+{
+	int list, count, seen = 0;
+	void *bp;
+
+	for (list = 0; list < QUICK_LISTS; list++) {
+		count = 0;
+		for (bp = a->quick[list]; bp != NULL; bp = QUICK_NEXT(bp)) {
+			if (++seen > cached || ++count > QUICK_COUNT)
+				return 0;
+			if (((size_t)bp % ALIGNMENT) != 0 || !ptr_is_mapped(HDRP(bp), 2*WSIZE))
+				return 0;
+			if ((GET(HDRP(bp)) & (ALLOC_BIT | QUICK_BIT)) != (ALLOC_BIT | QUICK_BIT)
+			    || QUICK_LIST(GET_SIZE(HDRP(bp))) != list)
+				return 0;
+		}
+		if (count != a->quick_count[list])
+			return 0;
+	}
+	return seen == cached && cached == a->quick_cached;
+}
+
+/*
+ * mm_check - Check whether freeing the given `p`, which means that
+ *            calling mm_free(p) leaves the heap in an ok state.
+ */
+int mm_can_free(void *p)
+{
+	void *entry;
+	arena *a;
+	int ok;
+
+#ifdef MM_THREADS
+	//a slot sitting in this thread's cache is already free
+	if (tcache_holds(p))
+		return 0;
+#endif
+
+	entry = registry_get(p);
+	a = entry_arena(entry);
+	if (a == NULL)
+		return 0;
+	arena_lock(a);
+#ifdef MM_THREADS
+	//a block waiting on the remote list is already free
+	arena_drain(a);
+	entry = registry_get(p);
+#endif
+	//from the first call on the arena's chunks keep start bitmaps, and
+	//in a single arena that registers them
+	if (!a->keep_starts && arena_keep_starts(a))
+		entry = registry_get(p);
+	ok = heap_can_free(entry, p);
+	arena_unlock(a);
+	return ok;
+}
+
+/*
+ * heap_can_free - mm_can_free against the page p's registry entry
+ *     says it is on
+ */
+static int heap_can_free(void *entry, void *p)
+{
+	void *bp;
+	span *s;
+	size_t bit;
+
+	if (REG_KIND(entry) == REG_SLAB)
+		return slab_can_free(REG_OWNER(entry), p);
+	if (REG_KIND(entry) == REG_LARGE)
+		return p == LARGE_PAYLOAD(REG_OWNER(entry));
+
+	//an unregistered chunk has to be looked for
+	if (entry != NULL)
+		s = CHUNK_SPAN(REG_CHUNK_START(entry));
+	else if (arenas[0].keep_starts)
+		return 0;
+	else {
+		for (s = arenas[0].first_span; s != NULL; s = s->next) {
+			if (!s->free && (char *)p > SPAN_START(s) && (char *)p < CHUNK_EPILOGUE(s))
+				break;
+		}
+		if (s == NULL)
+			return 0;
+	}
+
+	//a block in use starts at p when its start bit is set
+	if (s->arena->keep_starts) {
+		if ((char *)p < CHUNK_FIRST_BP(s) || (char *)p >= CHUNK_EPILOGUE(s) || (uintptr_t)p % ALIGNMENT != 0)
+			return 0;
+		bit = START_BIT(s, p);
+		return STARTS_GET(s, bit);
+	}
+
+	//points to first payload
+	bp = CHUNK_FIRST_BP(s);
+	while(HDRP(bp) != CHUNK_EPILOGUE(s) && (char *)bp <= (char *)p)
+	{
+		//a cached block is already free
+		if(bp == p)
+			return (GET(HDRP(bp)) & (ALLOC_BIT | QUICK_BIT)) == ALLOC_BIT;
+		bp = NEXT_BLKP(bp);
+	}
+	return 0;
+}
+
+
+/*
+ * set_allocated - mark a block that is out of the free index as
+ *     allocated, splitting off and indexing any usable remainder; a
+ *     purged block first recommits the pages the allocation and the
+ *     remainder's header and links take, and the remainder stays purged;
+ *     the remainder of a fresh block stays fresh too
+ */
+void set_allocated(arena *a, void *bp, size_t size) {
+	size_t extra_size = GET_SIZE(HDRP(bp)) - size;
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	size_t purged = GET(HDRP(bp)) & PURGED_BIT;
+	size_t fresh = GET(HDRP(bp)) & FRESH_BIT;
+	char *start, *end;
+
+	if (purged) {
+		start = ADDRESS_PAGE_START(HDRP(bp));
+		end = (char *)bp + size + sizeof(unalloc_bp);
+		if (end > FTRP(bp))
+			end = FTRP(bp);
+		arena_recommit(a, start, PAGE_ALIGN((size_t)(end - start)));
+	}
+
+	chunk_mark(a, bp, 1);
+	if (extra_size >= MIN_BLOCK_SIZE) {
+		a->splits++;
+		PUT(HDRP(bp), PACK(size, ALLOC_BIT | prev_alloc));
+		PUT(HDRP(NEXT_BLKP(bp)), PACK(extra_size, PREV_ALLOC_BIT | purged | fresh));
+		PUT(FTRP(NEXT_BLKP(bp)), extra_size);
+		insert_free(a, NEXT_BLKP(bp));
+	} else {
+		PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), ALLOC_BIT | prev_alloc));
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	}
+}
+
+/*
+ * coalesce - merge a just-freed block with its free neighbours, taking
+ *     them out of the free index; the caller indexes the result
+ */
+void *coalesce(arena *a, void *bp){
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+	size_t size = GET_SIZE(HDRP(bp));
+	size_t purged = 0, fresh = GET(HDRP(bp)) & FRESH_BIT;
+	void *prev;
+
+	//the merged block is fresh only if every part was, and then the
+	//footer, header and links where two parts meet are wiped
+	if (!next_alloc) {
+		a->coalesces++;
+		remove_free(a, NEXT_BLKP(bp));
+		purged |= GET(HDRP(NEXT_BLKP(bp))) & PURGED_BIT;
+		fresh &= GET(HDRP(NEXT_BLKP(bp)));
+		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+		if (fresh)
+			memset(FTRP(bp), 0, 2*WSIZE + sizeof(unalloc_bp));
+	}
+
+	if (!prev_alloc) {
+		a->coalesces++;
+		prev = PREV_BLKP(bp);
+		remove_free(a, prev);
+		purged |= GET(HDRP(prev)) & PURGED_BIT;
+		fresh &= GET(HDRP(prev));
+		size += GET_SIZE(HDRP(prev));
+		if (fresh)
+			memset((char *)bp - 2*WSIZE, 0, 2*WSIZE + sizeof(unalloc_bp));
+		bp = prev;
+	}
+
+	//a free block always follows an allocated one
+	PUT(HDRP(bp), PACK(size, PREV_ALLOC_BIT | purged | fresh));
+	PUT(FTRP(bp), size);
+	return bp;
+}
+
+/*
+ * purge_block - decommit the pages of free block bp that lie wholly
+ *     between lo and hi, past its links and before its footer, and
+ *     mark the block purged if there were any
+ */
+static void purge_block(arena *a, void *bp, char *lo, char *hi)
+{
+	char *start = (char *)bp + sizeof(unalloc_bp), *end = FTRP(bp);
+
+	if (lo > start)
+		start = lo;
+	if (hi < end)
+		end = hi;
+	start = (char *)PAGE_ALIGN((size_t)start);
+	end = ADDRESS_PAGE_START(end);
+	if (start >= end)
+		return;
+	arena_decommit(a, start, end - start);
+	PUT(HDRP(bp), GET(HDRP(bp)) | PURGED_BIT);
+}
+
+int ptr_is_mapped(void *p, size_t len) {
+    void *s = ADDRESS_PAGE_START(p);
+    return mem_is_mapped(s, PAGE_ALIGN((p + len) - s));
+}
+
+/*
+ * range_committed - whether every page that p to p+len touches is
+ *     committed
+ */
+static int range_committed(void *p, size_t len) {
+	void *s = ADDRESS_PAGE_START(p);
+	size_t size = PAGE_ALIGN((size_t)((char *)p + len - (char *)s));
+
+	return mem_committed(s, size) == size;
+}
+
+/*
+ * slab_malloc - take the first free slot of a partial slab page of
+ *     size's class, mapping a fresh slab page if the class has none
+ */
+static void *slab_malloc(arena *a, size_t size)
+{
+	unsigned int class = SLAB_CLASS(size);
+	slab_page *slab = a->slab_partial[class];
+	int w;
+	unsigned long bits;
+
+	if (slab == NULL) {
+		slab = arena_map(a, APAGE_SIZE);
+		if (slab == NULL)
+			return NULL;
+		if (!registry_set(slab, REG_ENTRY(slab, REG_SLAB))) {
+			arena_unmap(a, slab, APAGE_SIZE);
+			return NULL;
+		}
+		memset(slab->used, 0, sizeof(slab->used));
+		slab->class = class;
+		slab->nfree = SLAB_SLOTS(class);
+		slab->arena = a;
+		slab->prev = NULL;
+		slab->next = NULL;
+		a->slab_partial[class] = slab;
+		a->slab_count++;
+	}
+
+	//a partial slab always has a clear bit below SLAB_SLOTS(class)
+	for (w = 0; (bits = ~slab->used[w]) == 0; w++)
+		;
+	slab->used[w] |= bits & -bits;
+	slab->nfree--;
+
+	//a full slab leaves the partial list until one of its slots is freed
+	if (slab->nfree == 0) {
+		a->slab_partial[class] = slab->next;
+		if (slab->next != NULL)
+			slab->next->prev = NULL;
+		slab->next = NULL;
+	}
+
+	return SLAB_FIRST_SLOT(slab) + (w * 64 + __builtin_ctzl(bits)) * SLAB_SLOT_SIZE(class);
+}
+
+/*
+ * slab_free - clear p's slot, putting a full slab back on the partial
+ *     list and unmapping a slab whose last slot was freed
+ */
+static void slab_free(slab_page *slab, void *p)
+{
+	arena *a = slab->arena;
+	unsigned int class = slab->class;
+	size_t slot = ((char *)p - SLAB_FIRST_SLOT(slab)) / SLAB_SLOT_SIZE(class);
+
+	slab->used[slot / 64] &= ~(1UL << (slot % 64));
+
+	if (slab->nfree++ == 0) {
+		slab->prev = NULL;
+		slab->next = a->slab_partial[class];
+		if (slab->next != NULL)
+			slab->next->prev = slab;
+		a->slab_partial[class] = slab;
+	}
+
+	if (slab->nfree == SLAB_SLOTS(class)) {
+		if (slab->prev != NULL)
+			slab->prev->next = slab->next;
+		else
+			a->slab_partial[class] = slab->next;
+		if (slab->next != NULL)
+			slab->next->prev = slab->prev;
+		registry_set(slab, NULL);
+		a->slab_count--;
+		arena_unmap(a, slab, APAGE_SIZE);
+	}
+}
+
+/*
+ * slab_can_free - whether p is the start of an allocated slot
+ */
+static int slab_can_free(slab_page *slab, void *p)
+{
+	size_t offset, slot;
+
+	if ((char *)p < SLAB_FIRST_SLOT(slab))
+		return 0;
+	offset = (char *)p - SLAB_FIRST_SLOT(slab);
+	if (offset % SLAB_SLOT_SIZE(slab->class) != 0)
+		return 0;
+	slot = offset / SLAB_SLOT_SIZE(slab->class);
+	if (slot >= SLAB_SLOTS(slab->class))
+		return 0;
+	return (slab->used[slot / 64] >> (slot % 64)) & 1;
+}
+
+/*
+ * check_slab - Check one registered slab page's header and bitmap
+ */
+static int check_slab(slab_page *slab)
+{
+	unsigned int slots, used = 0;
+	int w;
+
+	if (slab->class >= SLAB_CLASS_COUNT || !ARENA_VALID(slab->arena))
+		return 0;
+	slots = SLAB_SLOTS(slab->class);
+	for (w = 0; w < SLAB_BITMAP_WORDS; w++) {
+		//bits past the last slot stay clear
+		if (w * 64 + 64 > slots && (slab->used[w] >> (slots > w * 64 ? slots - w * 64 : 0)) != 0)
+			return 0;
+		used += __builtin_popcountl(slab->used[w]);
+	}
+	if (used == 0 || slab->nfree != slots - used)
+		return 0;
+	if (slab->nfree == 0 && (slab->next != NULL || slab->prev != NULL))
+		return 0;
+	return 1;
+}
+
+/*
+ * check_slabs - Check every partial list of an arena; a full check
+ *     has already checked the registry to hold exactly the slab pages,
+ *     so otherwise the pages on the lists are checked here
+ */
+static int check_slabs(arena *a, int full)
+{
+	unsigned int class;
+	size_t partial = 0;
+	slab_page *slab, *prev;
+
+	for (class = 0; class < SLAB_CLASS_COUNT; class++) {
+		prev = NULL;
+		for (slab = a->slab_partial[class]; slab != NULL; slab = slab->next) {
+			if (++partial > a->slab_count)
+				return 0;
+			if (registry_get(slab) != REG_ENTRY(slab, REG_SLAB) || slab->arena != a
+			    || slab->class != class || slab->prev != prev || slab->nfree == 0)
+				return 0;
+			if (!full && !check_slab(slab))
+				return 0;
+			prev = slab;
+		}
+	}
+	return 1;
+}
+
+/*
+ * large_malloc - give a request of at least MMAP_THRESHOLD bytes a
+ *     mapping of its own, reusing a cached one of about the same size;
+ *     with zero set, a reused mapping has its first size bytes zeroed
+ */
+static void *large_malloc(arena *a, size_t size, int zero)
+{
+	size_t length = PAGE_ALIGN(size + sizeof(large_header));
+	large_header *large = NULL;
+	char *payload, *start, *end;
+	int i, best = -1;
+
+	for (i = 0; i < a->large_cached; i++) {
+		if (a->large_cache[i].length >= length && LARGE_CACHE_FIT(length, a->large_cache[i].length)
+		    && (best < 0 || a->large_cache[i].length < a->large_cache[best].length))
+			best = i;
+	}
+
+	if (best >= 0) {
+		large = a->large_cache[best].large;
+		length = a->large_cache[best].length;
+		a->large_cached_bytes -= length;
+		a->large_cached--;
+		memmove(&a->large_cache[best], &a->large_cache[best + 1], (a->large_cached - best) * sizeof(a->large_cache[0]));
+
+		//whole pages are swapped for zero pages when there are enough
+		payload = LARGE_PAYLOAD(large);
+		start = (char *)PAGE_ALIGN((size_t)payload);
+		end = ADDRESS_PAGE_START(payload + size);
+		if (zero && end - start >= LARGE_ZERO_BYTES) {
+			memset(payload, 0, start - payload);
+			arena_zero(start, end - start);
+			memset(end, 0, payload + size - end);
+		} else if (zero)
+			memset(payload, 0, size);
+	} else {
+		large = arena_map(a, length);
+		if (large == NULL)
+			return NULL;
+	}
+
+	if (!registry_set(large, REG_ENTRY(large, REG_LARGE))) {
+		arena_unmap(a, large, length);
+		return NULL;
+	}
+	large->length = length;
+	large->arena = a;
+	a->large_count++;
+	return LARGE_PAYLOAD(large);
+}
+
+/*
+ * large_free - park a large block's mapping in its arena's cache,
+ *     evicting the oldest entries to make room, or unmap it if it is
+ *     too big
+ */
+static void large_free(large_header *large)
+{
+	arena *a = large->arena;
+	size_t length = large->length;
+
+	registry_set(large, NULL);
+	a->large_count--;
+
+	if (length > LARGE_CACHE_BYTES) {
+		arena_unmap(a, large, length);
+		return;
+	}
+
+	while (a->large_cached == LARGE_CACHE_SLOTS || a->large_cached_bytes + length > LARGE_CACHE_BYTES) {
+		arena_unmap(a, a->large_cache[0].large, a->large_cache[0].length);
+		a->large_cached_bytes -= a->large_cache[0].length;
+		a->large_cached--;
+		memmove(&a->large_cache[0], &a->large_cache[1], a->large_cached * sizeof(a->large_cache[0]));
+	}
+
+	a->large_cache[a->large_cached].large = large;
+	a->large_cache[a->large_cached].length = length;
+	a->large_cached++;
+	a->large_cached_bytes += length;
+}
+
+/*
+ * check_large_block - Check one registered large mapping's header
+ */
+static int check_large_block(large_header *large)
+{
+	return large->length >= PAGE_ALIGN(MMAP_THRESHOLD + sizeof(large_header))
+		&& large->length == PAGE_ALIGN(large->length)
+		&& ARENA_VALID(large->arena)
+		&& ptr_is_mapped(large, large->length);
+}
+
+/*
+ * check_large - Check that an arena's cached mappings are still mapped
+ *     and within the cache bounds
+ */
+static int check_large(arena *a)
+{
+	size_t bytes = 0;
+	int i;
+
+	if (a->large_cached < 0 || a->large_cached > LARGE_CACHE_SLOTS)
+		return 0;
+	for (i = 0; i < a->large_cached; i++) {
+		if (!ptr_is_mapped(a->large_cache[i].large, a->large_cache[i].length))
+			return 0;
+		bytes += a->large_cache[i].length;
+	}
+	return bytes == a->large_cached_bytes && bytes <= LARGE_CACHE_BYTES;
+}
+
+/*
+ * mm_region_create - a new region, with a first chunk that holds the
+ *     region itself; NULL if it cannot be mapped
+ */
+mm_region_t *mm_region_create(void)
+{
+	region_chunk *c;
+	mm_region_t *r;
+
+	if ((c = region_map(REGION_CHUNK_SIZE)) == NULL)
+		return NULL;
+	c->next = NULL;
+	r = (mm_region_t *)((char *)c + REGION_CHUNK_BYTES);
+	r->chunks = c;
+	r->next = (char *)r + ALIGN(sizeof(mm_region_t));
+	r->end = (char *)c + c->size;
+	r->chunk_size = 2 * REGION_CHUNK_SIZE;
+	return r;
+}
+
+/*
+ * mm_region_malloc - Allocate a block from region r by bumping its
+ *     pointer, mapping a new chunk when the current one is full. The
+ *     block has no header and cannot be freed on its own.
+ */
+void *mm_region_malloc(mm_region_t *r, size_t size)
+{
+	void *p;
+
+	if (size == 0 || size > MAX_REQUEST)
+		return NULL;
+	size = ALIGN(size);
+	if (size > (size_t)(r->end - r->next))
+		return region_grow(r, size);
+	p = r->next;
+	r->next += size;
+	return p;
+}
+
+/*
+ * mm_region_destroy - free every block of region r, and r with them,
+ *     by unmapping its chunks
+ */
+void mm_region_destroy(mm_region_t *r)
+{
+	region_chunk *c, *next;
+
+	if (r == NULL)
+		return;
+	//r lives in the first chunk, which is the last on the list
+	for (c = r->chunks; c != NULL; c = next) {
+		next = c->next;
+		arena_unmap(NULL, c, c->size);
+	}
+}
+
+/*
+ * region_map - map a region chunk of at least size bytes, whole
+ *     mapping units like a span's, and record its length
+ */
+static region_chunk *region_map(size_t size)
+{
+	size_t unit = mem_mapunit();
+	region_chunk *c;
+
+	size = (size + unit - 1) & ~(unit - 1);
+	if ((c = arena_map(NULL, size)) == NULL)
+		return NULL;
+	c->size = size;
+	return c;
+}
+
+/*
+ * region_grow - serve a request of size bytes that the room left in
+ *     region r does not fit from a new chunk. The region goes on to
+ *     bump through the new chunk unless that leaves it less room than
+ *     the current one, as after a request bigger than a chunk.
+ */
+static void *region_grow(mm_region_t *r, size_t size)
+{
+	size_t need = PAGE_ALIGN(REGION_CHUNK_BYTES + size);
+	region_chunk *c;
+	char *p;
+
+	if ((c = region_map(need > r->chunk_size ? need : r->chunk_size)) == NULL)
+		return NULL;
+	p = (char *)c + REGION_CHUNK_BYTES;
+	if ((char *)c + c->size - (p + size) < r->end - r->next) {
+		c->next = r->chunks->next;
+		r->chunks->next = c;
+		return p;
+	}
+
+	c->next = r->chunks;
+	r->chunks = c;
+	r->next = p + size;
+	r->end = (char *)c + c->size;
+	if (r->chunk_size < REGION_CHUNK_MAX)
+		r->chunk_size *= 2;
+	return p;
+}
+
+/*
+ * entry_arena - arena owning the page with registry entry entry, or
+ *     NULL if the page is not the allocator's; a page without an
+ *     entry is taken to be a chunk's when chunks are not registered
+ */
+static arena *entry_arena(void *entry)
+{
+	if (REG_KIND(entry) == REG_SLAB)
+		return ((slab_page *)REG_OWNER(entry))->arena;
+	if (REG_KIND(entry) == REG_LARGE)
+		return ((large_header *)REG_OWNER(entry))->arena;
+	if (REG_KIND(entry) == REG_CHUNK)
+		return REG_CHUNK_ARENA(entry);
+	return ARENA_COUNT > 1 ? NULL : &arenas[0];
+}
+
+/*
+ * arena_map - mem_map size bytes for arena a, counting them in its
+ *     heap size; memlib is shared, so it is only entered under a lock
+ */
+static void *arena_map(arena *a, size_t size)
+{
+	void *p;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+	p = mem_map(size);
+	if (p != NULL)
+		mapped_bytes += size;
+	pthread_mutex_unlock(&mem_lock);
+#else
+	p = mem_map(size);
+	if (p != NULL)
+		mapped_bytes += size;
+#endif
+	if (p == NULL)
+		return NULL;
+
+	if (a != NULL) {
+		a->heap_size += size;
+		if (a->heap_size > a->heap_peak)
+			a->heap_peak = a->heap_size;
+	}
+	return p;
+}
+
+/*
+ * arena_unmap - mem_unmap pages that arena_map gave to a
+ */
+static void arena_unmap(arena *a, void *p, size_t size)
+{
+	size_t committed;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+#endif
+	committed = mem_committed(p, size);
+	mem_unmap(p, size);
+	unmapped_bytes += size;
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&mem_lock);
+#endif
+	if (a != NULL)
+		a->heap_size -= committed;
+}
+
+/*
+ * arena_decommit - mem_decommit pages of arena a, taking the ones that
+ *     were committed out of its heap size
+ */
+static void arena_decommit(arena *a, void *p, size_t size)
+{
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+	a->heap_size -= mem_decommit(p, size);
+	pthread_mutex_unlock(&mem_lock);
+#else
+	a->heap_size -= mem_decommit(p, size);
+#endif
+}
+
+/*
+ * arena_recommit - mem_recommit pages of arena a that are about to be
+ *     written, counting the ones that were decommitted in its heap size
+ */
+static void arena_recommit(arena *a, void *p, size_t size)
+{
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+	a->heap_size += mem_recommit(p, size);
+	pthread_mutex_unlock(&mem_lock);
+#else
+	a->heap_size += mem_recommit(p, size);
+#endif
+	if (a->heap_size > a->heap_peak)
+		a->heap_peak = a->heap_size;
+}
+
+/*
+ * arena_zero - mem_zero committed pages, under the memlib lock
+ */
+static void arena_zero(void *p, size_t size)
+{
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+	mem_zero(p, size);
+	pthread_mutex_unlock(&mem_lock);
+#else
+	mem_zero(p, size);
+#endif
+}
+
+#ifdef MM_THREADS
+/*
+ * arena_lock - take an arena's lock, counting the times it was busy
+ */
+static void arena_lock(arena *a)
+{
+	int busy = pthread_mutex_trylock(&a->lock) != 0;
+
+	//lock_thread_arena reads contended before it has the lock
+	if (busy) {
+		pthread_mutex_lock(&a->lock);
+		__atomic_add_fetch(&a->contended, 1, __ATOMIC_RELAXED);
+	}
+	a->locks++;
+}
+
+static void arena_unlock(arena *a)
+{
+	pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * thread_exit - hand an exiting thread's cache back, take it off its
+ *     arena and add its block counts to those of exited threads
+ */
+static void thread_exit(void *arg)
+{
+	thread_cache *cache = arg;
+	unsigned int class;
+
+	for (class = 0; class < SLAB_CLASS_COUNT; class++)
+		tcache_flush(cache, class, TCACHE_COUNT);
+	if (tarena != NULL)
+		__atomic_sub_fetch(&tarena->threads, 1, __ATOMIC_RELAXED);
+	tarena = NULL;
+
+	pthread_mutex_lock(&stats_lock);
+	stats_fold(stats_exited.mallocs, stats_exited.frees, &tstats);
+	if (tstats.prev != NULL)
+		tstats.prev->next = tstats.next;
+	else
+		stats_threads = tstats.next;
+	if (tstats.next != NULL)
+		tstats.next->prev = tstats.prev;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void thread_key_create(void)
+{
+	if (pthread_key_create(&thread_key, thread_exit) != 0)
+		abort();
+}
+
+/*
+ * thread_register - arrange for thread_exit to run when this thread
+ *     exits, and put its block counts where mm_get_stats finds them
+ */
+static void thread_register(void)
+{
+	pthread_once(&thread_once, thread_key_create);
+	pthread_setspecific(thread_key, &tcache);
+	tregistered = 1;
+
+	pthread_mutex_lock(&stats_lock);
+	tstats.cache = &tcache;
+	tstats.prev = NULL;
+	tstats.next = stats_threads;
+	if (stats_threads != NULL)
+		stats_threads->prev = &tstats;
+	stats_threads = &tstats;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * arena_assign - move this thread to the arena with the fewest
+ *     threads other than skip, searching from a rotating start so that
+ *     ties are spread round-robin; a thread stays on skip unless that
+ *     makes it less loaded
+ */
+static arena *arena_assign(arena *skip)
+{
+	unsigned int start = __atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED);
+	arena *a, *best = NULL;
+	int i;
+
+	for (i = 0; i < ARENA_COUNT; i++) {
+		a = &arenas[(start + i) % ARENA_COUNT];
+		if (a != skip && (best == NULL || __atomic_load_n(&a->threads, __ATOMIC_RELAXED)
+		                                  < __atomic_load_n(&best->threads, __ATOMIC_RELAXED)))
+			best = a;
+	}
+	if (best == NULL || (skip != NULL && __atomic_load_n(&best->threads, __ATOMIC_RELAXED)
+	                                     >= __atomic_load_n(&skip->threads, __ATOMIC_RELAXED)))
+		return skip;
+
+	if (!tregistered)
+		thread_register();
+	if (tarena != NULL)
+		__atomic_sub_fetch(&tarena->threads, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&best->threads, 1, __ATOMIC_RELAXED);
+	tarena = best;
+	return best;
+}
+
+/*
+ * lock_thread_arena - lock this thread's arena, assigning one first
+ *     if it has none, and move the thread elsewhere for its next
+ *     request if the lock keeps being busy; blocks other threads
+ *     have freed into the arena are taken back first
+ */
+static arena *lock_thread_arena(void)
+{
+	arena *a = tarena != NULL ? tarena : arena_assign(NULL);
+	unsigned long contended = __atomic_load_n(&a->contended, __ATOMIC_RELAXED);
+
+	arena_lock(a);
+	if (a->contended == contended)
+		tcontention = 0;
+	else if (++tcontention >= ARENA_CONTENTION_LIMIT) {
+		tcontention = 0;
+		arena_assign(a);
+	}
+	arena_drain(a);
+	return a;
+}
+
+/*
+ * tcache_flush - hand the first n cached slots of class back to their
+ *     slab pages, holding each slab's arena lock in turn, or onto the
+ *     remote lists of other threads' arenas
+ */
+static void tcache_flush(thread_cache *cache, unsigned int class, unsigned int n)
+{
+	arena *locked = NULL;
+	slab_page *slab;
+	void *p;
+
+	while (n-- > 0 && (p = cache->head[class]) != NULL) {
+		cache->head[class] = *(void **)p;
+		cache->count[class]--;
+		slab = REG_OWNER(registry_get(p));
+		if (slab->arena != tarena && remote_free) {
+			remote_push(slab->arena, p);
+			continue;
+		}
+		if (slab->arena != locked) {
+			if (locked != NULL)
+				arena_unlock(locked);
+			locked = slab->arena;
+			arena_lock(locked);
+		}
+		slab_free(slab, p);
+	}
+	if (locked != NULL)
+		arena_unlock(locked);
+}
+
+/*
+ * tcache_malloc - pop a slot of class from this thread's cache,
+ *     refilling the cache from the thread's arena first if it is empty
+ */
+static void *tcache_malloc(unsigned int class)
+{
+	arena *a;
+	void *p;
+	int i;
+
+	if (tcache.head[class] == NULL) {
+		a = lock_thread_arena();
+		for (i = 0; i < TCACHE_BATCH; i++) {
+			p = slab_malloc(a, SLAB_SLOT_SIZE(class));
+			if (p == NULL)
+				break;
+			*(void **)p = tcache.head[class];
+			tcache.head[class] = p;
+			tcache.count[class]++;
+		}
+		arena_unlock(a);
+
+		if (tcache.head[class] == NULL)
+			return NULL;
+	}
+
+	p = tcache.head[class];
+	tcache.head[class] = *(void **)p;
+	tcache.count[class]--;
+	tstats.mallocs[class]++;
+	return p;
+}
+
+/*
+ * tcache_free - push a freed slot of class onto this thread's cache,
+ *     handing half of a full cache back to the slab pages first
+ */
+static void tcache_free(unsigned int class, void *p)
+{
+	if (!tregistered)
+		thread_register();
+
+	if (tcache.count[class] == TCACHE_COUNT)
+		tcache_flush(&tcache, class, TCACHE_BATCH);
+
+	*(void **)p = tcache.head[class];
+	tcache.head[class] = p;
+	tcache.count[class]++;
+	tstats.frees[class]++;
+}
+
+/*
+ * tcache_holds - whether p sits in this thread's cache
+ */
+static int tcache_holds(void *p)
+{
+	void *entry = registry_get(p), *q;
+	unsigned int class, n = 0;
+
+	if (REG_KIND(entry) != REG_SLAB)
+		return 0;
+	class = ((slab_page *)REG_OWNER(entry))->class;
+	if (class >= SLAB_CLASS_COUNT)
+		return 0;
+	for (q = tcache.head[class]; q != NULL && n < tcache.count[class]; q = *(void **)q, n++) {
+		if (q == p)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * check_tcache - Check that every slot in this thread's cache is an
+ *     allocated slot of its class and that the counts are right; the
+ *     registry has already been checked
+ */
+static int check_tcache(void)
+{
+	unsigned int class, n;
+	void *p, *entry;
+
+	for (class = 0; class < SLAB_CLASS_COUNT; class++) {
+		if (tcache.count[class] > TCACHE_COUNT)
+			return 0;
+		n = 0;
+		for (p = tcache.head[class]; p != NULL; p = *(void **)p) {
+			if (++n > tcache.count[class])
+				return 0;
+			entry = registry_get(p);
+			if (REG_KIND(entry) != REG_SLAB || ((slab_page *)REG_OWNER(entry))->class != class
+			    || !slab_can_free(REG_OWNER(entry), p))
+				return 0;
+		}
+		if (n != tcache.count[class])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * remote_push - free p into another thread's arena a without its
+ *     lock, by pushing it onto a's remote list
+ */
+static void remote_push(arena *a, void *p)
+{
+	void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+	do {
+		*(void **)p = head;
+	} while (!__atomic_compare_exchange_n(&a->remote, &head, p, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_free_list - free the blocks of a list taken off a's remote
+ *     list; the caller holds a's lock
+ */
+static void remote_free_list(arena *a, void *p)
+{
+	void *next;
+
+	for (; p != NULL; p = next) {
+		next = *(void **)p;
+		heap_free(registry_get(p), p);
+		a->remote_frees++;
+	}
+}
+
+/*
+ * arena_drain - take the whole remote list of arena a, whose lock the
+ *     caller holds, and free its blocks
+ */
+static void arena_drain(arena *a)
+{
+	if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) != NULL)
+		remote_free_list(a, __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * check_remote - Take an arena's remote list and check that it only
+ *     holds allocated blocks of the arena before freeing them; the
+ *     registry has already been checked
+ */
+static int check_remote(arena *a)
+{
+	void *list = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+	void *p, *entry;
+	size_t n = 0;
+
+	for (p = list; p != NULL; p = *(void **)p) {
+		if (++n > a->heap_size / ALIGNMENT)
+			return 0;
+		entry = registry_get(p);
+		if (entry_arena(entry) != a || !heap_can_free(entry, p))
+			return 0;
+	}
+	remote_free_list(a, list);
+	return 1;
+}
+#else
+static void arena_lock(arena *a)
+{
+}
+
+static void arena_unlock(arena *a)
+{
+}
+
+static arena *lock_thread_arena(void)
+{
+	return &arenas[0];
+}
+#endif
+
+/*
+ * mm_arena_count - number of arenas
+ */
+int mm_arena_count(void)
+{
+	return ARENA_COUNT;
+}
+
+/*
+ * mm_arena_stats - fill in stats for arena i; 0 if there is no such
+ *     arena
+ */
+int mm_arena_stats(int i, mm_arena_stats_t *stats)
+{
+	arena *a;
+
+	if (i < 0 || i >= ARENA_COUNT)
+		return 0;
+	a = &arenas[i];
+
+	arena_lock(a);
+	stats->heap_size = a->heap_size;
+	stats->heap_peak = a->heap_peak;
+	stats->locks = a->locks;
+	stats->contended = a->contended;
+	stats->threads = a->threads;
+	stats->remote_frees = a->remote_frees;
+	stats->retained = a->retained;
+	stats->retain_hits = a->retain_hits;
+	stats->retain_misses = a->retain_misses;
+	stats->retain_releases = a->retain_releases;
+	arena_unlock(a);
+	return 1;
+}
+
+/*
+ * mm_get_stats - fill in the counters of the whole allocator: the
+ *     block counts of every thread and the work and caches of every
+ *     arena
+ */
+void mm_get_stats(mm_stats_t *stats)
+{
+	arena *a;
+	int i, c;
+#ifdef MM_THREADS
+	thread_stats *t;
+#endif
+
+	memset(stats, 0, sizeof(*stats));
+	stats->classes = STATS_CLASSES;
+	for (c = 0; c < SLAB_CLASS_COUNT; c++)
+		stats->class_size[c] = SLAB_SLOT_SIZE(c);
+	stats->class_size[STATS_CHUNK] = MMAP_THRESHOLD - 1;
+
+	//other threads' counts and caches are read as they change
+#ifdef MM_THREADS
+	pthread_mutex_lock(&stats_lock);
+	stats_fold(stats->mallocs, stats->frees, &stats_exited);
+	for (t = stats_threads; t != NULL; t = t->next) {
+		stats_fold(stats->mallocs, stats->frees, t);
+		for (c = 0; c < SLAB_CLASS_COUNT; c++)
+			stats->cached_bytes += (size_t)__atomic_load_n(&t->cache->count[c], __ATOMIC_RELAXED)
+				* SLAB_SLOT_SIZE(c);
+	}
+	pthread_mutex_unlock(&stats_lock);
+#else
+	stats_fold(stats->mallocs, stats->frees, &tstats);
+#endif
+
+	for (i = 0; i < ARENA_COUNT; i++) {
+		a = &arenas[i];
+		arena_lock(a);
+		stats->splits += a->splits;
+		stats->coalesces += a->coalesces;
+		stats->extends += a->extends;
+		stats->chunk_releases += a->chunk_releases;
+		stats->huge_spans += a->huge_spans;
+		stats->searches += a->searches;
+		stats->search_steps += a->search_steps;
+		for (c = 0; c < QUICK_LISTS; c++)
+			stats->cached_bytes += (size_t)a->quick_count[c] * (c + 1) * ALIGNMENT;
+		stats->cached_bytes += a->large_cached_bytes + a->retained;
+		arena_unlock(a);
+	}
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&mem_lock);
+#endif
+	stats->mapped_bytes = mapped_bytes;
+	stats->unmapped_bytes = unmapped_bytes;
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&mem_lock);
+#endif
+}
+
+/*
+ * stats_fold - add the block counts of thread t to mallocs and frees
+ */
+static void stats_fold(unsigned long *mallocs, unsigned long *frees, thread_stats *t)
+{
+	int c;
+
+	for (c = 0; c < STATS_CLASSES; c++) {
+		mallocs[c] += __atomic_load_n(&t->mallocs[c], __ATOMIC_RELAXED);
+		frees[c] += __atomic_load_n(&t->frees[c], __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * mm_setopt - set one of the MM_OPT_ options; 0 if it is unknown or
+ *     does not apply to this build
+ */
+int mm_setopt(int option, long value)
+{
+	void *stack;
+
+	switch (option) {
+#ifdef MM_THREADS
+	case MM_OPT_REMOTE_FREE:
+		remote_free = value != 0;
+		return 1;
+#endif
+	case MM_OPT_RETAIN_LIMIT:
+		if (value < 0)
+			return 0;
+		retain_limit = (size_t)value;
+		return 1;
+	case MM_OPT_PURGE_BYTES:
+		if (value < 0)
+			return 0;
+		purge_bytes = (size_t)value;
+		return 1;
+	case MM_OPT_CHECK_FULL:
+		if (value < 1)
+			return 0;
+		check_full = value;
+		check_calls = 0;
+		return 1;
+	case MM_OPT_SAMPLE_BYTES:
+		if (value < 0)
+			return 0;
+		//the first backtrace() loads the unwinder; do that now rather
+		//than inside the first sampled allocation
+		if (value > 0)
+			backtrace(&stack, 1);
+		__atomic_store_n(&sample_bytes, value, __ATOMIC_RELAXED);
+		//other threads notice within SAMPLE_IDLE_BYTES of allocation
+		sample_left = 0;
+		return 1;
+	case MM_OPT_ADDRESS_ORDER:
+		if (value != 0 && value != 1)
+			return 0;
+		address_order = (int)value;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * sample_alloc - Slow path of SAMPLE_DUE: record the stack that
+ *     allocated block bp of size bytes, unless bp is NULL, and count
+ *     down to the next sample from a random interval of on average
+ *     sample_bytes bytes. It is called from the mm_ function itself
+ *     and not in tail position, so the caller's frame is two up.
+ */
+static __attribute__((noinline)) void sample_alloc(void *bp, size_t size)
+{
+	long mean = __atomic_load_n(&sample_bytes, __ATOMIC_RELAXED);
+	void *stack[SAMPLE_DEPTH + 2];
+	sample *t, *old;
+	size_t slots, i, j;
+	double u;
+	int depth;
+
+	if (mean == 0) {
+		sample_left = SAMPLE_IDLE_BYTES;
+		return;
+	}
+
+	//exponential intervals make the samples a Poisson process over the
+	//bytes allocated, which is what pprof assumes to scale them up
+	if (sample_seed == 0)
+		sample_seed = (uintptr_t)&sample_seed | 1;
+	sample_seed ^= sample_seed << 13;
+	sample_seed ^= sample_seed >> 7;
+	sample_seed ^= sample_seed << 17;
+	u = ((sample_seed >> 11) + 0.5) / (double)((uint64_t)1 << 53);
+	sample_left = (long)(-log(u) * mean);
+	if (bp == NULL)
+		return;
+
+	//skip this frame and the mm_ call that sampled
+	depth = backtrace(stack, SAMPLE_DEPTH + 2) - 2;
+	if (depth < 0)
+		depth = 0;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&sample_lock);
+#endif
+	//keep the table at most half full, growing it by doubling; a block
+	//goes unsampled when there is no memory for that
+	if (2 * (sample_live + 1) > sample_slots) {
+		slots = sample_slots != 0 ? 2 * sample_slots : SAMPLE_SLOTS;
+		t = arena_map(NULL, PAGE_ALIGN(slots * sizeof(sample)));
+		if (t == NULL) {
+#ifdef MM_THREADS
+			pthread_mutex_unlock(&sample_lock);
+#endif
+			return;
+		}
+		for (i = 0; i < sample_slots; i++) {
+			if (samples[i].p == NULL)
+				continue;
+			for (j = SAMPLE_HOME(samples[i].p, slots); t[j].p != NULL; j = (j + 1) & (slots - 1))
+				;
+			t[j] = samples[i];
+		}
+		old = samples;
+		samples = t;
+		if (old != NULL)
+			arena_unmap(NULL, old, PAGE_ALIGN(sample_slots * sizeof(sample)));
+		sample_slots = slots;
+	}
+
+	for (i = SAMPLE_HOME(bp, sample_slots); samples[i].p != NULL; i = (i + 1) & (sample_slots - 1))
+		;
+	samples[i].p = bp;
+	samples[i].size = size;
+	samples[i].depth = depth;
+	memcpy(samples[i].stack, stack + 2, depth * sizeof(void *));
+	__atomic_store_n(&sample_live, sample_live + 1, __ATOMIC_RELAXED);
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&sample_lock);
+#endif
+}
+
+/*
+ * sample_free - Drop the sample of block p, if it has one, moving the
+ *     blocks probed past its slot back so that no probe stops early
+ */
+static void sample_free(void *p)
+{
+	size_t i, j, home, mask;
+
+	if (p == NULL)
+		return;
+#ifdef MM_THREADS
+	pthread_mutex_lock(&sample_lock);
+#endif
+	mask = sample_slots - 1;
+	for (i = SAMPLE_HOME(p, sample_slots); sample_slots != 0 && samples[i].p != NULL; i = (i + 1) & mask) {
+		if (samples[i].p != p)
+			continue;
+
+		//a block after the hole moves into it unless its home slot
+		//lies cyclically after the hole and at or before the block
+		for (j = (i + 1) & mask; samples[j].p != NULL; j = (j + 1) & mask) {
+			home = SAMPLE_HOME(samples[j].p, sample_slots);
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				samples[i] = samples[j];
+				i = j;
+			}
+		}
+		samples[i].p = NULL;
+		__atomic_store_n(&sample_live, sample_live - 1, __ATOMIC_RELAXED);
+		break;
+	}
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&sample_lock);
+#endif
+}
+
+/*
+ * sample_order - qsort order of two samples, by stack
+ */
+static int sample_order(const void *p, const void *q)
+{
+	const sample *x = *(sample * const *)p, *y = *(sample * const *)q;
+	int i;
+
+	for (i = 0; i < x->depth && i < y->depth; i++)
+		if (x->stack[i] != y->stack[i])
+			return (uintptr_t)x->stack[i] < (uintptr_t)y->stack[i] ? -1 : 1;
+	return x->depth - y->depth;
+}
+
+/*
+ * mm_heap_profile_dump - Write the live sampled blocks to f in the
+ *     legacy heap profile format of gperftools, which pprof reads: a
+ *     line per distinct stack with its sampled blocks and bytes, and
+ *     the process mappings to symbolize the stacks with. Returns 0 if
+ *     the profile could not be written.
+ */
+int mm_heap_profile_dump(FILE *f)
+{
+	sample **order = NULL;
+	size_t n = 0, i, j, k, blocks, bytes, total = 0, order_bytes = 0;
+	char buf[4096];
+	FILE *maps;
+	int ok;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&sample_lock);
+#endif
+	//group the samples by stack
+	if (sample_live != 0) {
+		order_bytes = PAGE_ALIGN(sample_live * sizeof(sample *));
+		order = arena_map(NULL, order_bytes);
+		if (order == NULL) {
+#ifdef MM_THREADS
+			pthread_mutex_unlock(&sample_lock);
+#endif
+			return 0;
+		}
+		for (i = 0; i < sample_slots; i++)
+			if (samples[i].p != NULL) {
+				order[n++] = &samples[i];
+				total += samples[i].size;
+			}
+		qsort(order, n, sizeof(sample *), sample_order);
+	}
+
+	fprintf(f, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%ld\n",
+		n, total, n, total, __atomic_load_n(&sample_bytes, __ATOMIC_RELAXED));
+	for (i = 0; i < n; i = j) {
+		blocks = 0;
+		bytes = 0;
+		for (j = i; j < n && sample_order(&order[i], &order[j]) == 0; j++) {
+			blocks++;
+			bytes += order[j]->size;
+		}
+		fprintf(f, "%zu: %zu [%zu: %zu] @", blocks, bytes, blocks, bytes);
+		for (k = 0; k < (size_t)order[i]->depth; k++)
+			fprintf(f, " %p", order[i]->stack[k]);
+		fprintf(f, "\n");
+	}
+
+	fprintf(f, "\nMAPPED_LIBRARIES:\n");
+	if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+		while ((k = fread(buf, 1, sizeof(buf), maps)) > 0)
+			fwrite(buf, 1, k, f);
+		fclose(maps);
+	}
+	ok = !ferror(f);
+	if (order != NULL)
+		arena_unmap(NULL, order, order_bytes);
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&sample_lock);
+#endif
+	return ok;
+}
+
+/*
+ * check_samples - Make sure the sample table holds sample_live blocks,
+ *     each one in use and found by a probe from its home slot.
+ */
+static int check_samples(void)
+{
+	size_t i, j, live = 0;
+	int ok = 1;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&sample_lock);
+#endif
+	if (sample_slots != 0 && ((sample_slots & (sample_slots - 1)) != 0
+				  || !ptr_is_mapped(samples, sample_slots * sizeof(sample))))
+		ok = 0;
+	for (i = 0; ok && i < sample_slots; i++) {
+		if (samples[i].p == NULL)
+			continue;
+		live++;
+		if (samples[i].depth < 0 || samples[i].depth > SAMPLE_DEPTH
+		    || !heap_can_free(registry_get(samples[i].p), samples[i].p))
+			ok = 0;
+		for (j = SAMPLE_HOME(samples[i].p, sample_slots); ok && j != i; j = (j + 1) & (sample_slots - 1))
+			if (samples[j].p == NULL)
+				ok = 0;
+	}
+	ok = ok && live == sample_live;
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&sample_lock);
+#endif
+	return ok;
+}
+
+/*
+ * registry_slot - leaf entry for p's page, mapping missing nodes on
+ *     the way down when create is set; NULL if there is none. Lookups
+ *     take no lock, so a new node is published with a release store
+ *     and each link is read with an acquire load.
+ */
+static void **registry_slot(void *p, int create)
+{
+	uintptr_t key = (uintptr_t)p >> LOG_APAGE_SIZE;
+	uintptr_t top = key >> (REG_LEVELS * REG_BITS);
+	void **node, *next;
+	int level;
+
+	if (top >= REG_ROOT_FANOUT)
+		return NULL;
+
+	node = &reg_root[top];
+	for (level = REG_LEVELS - 1; level >= 0; level--) {
+		next = __atomic_load_n(node, __ATOMIC_ACQUIRE);
+		if (next == NULL) {
+			if (!create)
+				return NULL;
+			if ((next = arena_map(NULL, APAGE_SIZE)) == NULL)
+				return NULL;
+			__atomic_store_n(node, next, __ATOMIC_RELEASE);
+			reg_nodes++;
+		}
+		node = (void **)next + REG_INDEX(key, level);
+	}
+	return node;
+}
+
+/*
+ * registry_get - entry recorded for p's page, or NULL
+ */
+static void *registry_get(void *p)
+{
+	void **slot = registry_slot(p, 0);
+	return slot != NULL ? __atomic_load_n(slot, __ATOMIC_ACQUIRE) : NULL;
+}
+
+/*
+ * registry_set - record entry for p's page; clearing never maps
+ */
+static int registry_set(void *p, void *entry)
+{
+	void **slot;
+
+#ifdef MM_THREADS
+	pthread_mutex_lock(&registry_lock);
+#endif
+	slot = registry_slot(p, entry != NULL);
+	if (slot != NULL)
+		__atomic_store_n(slot, entry, __ATOMIC_RELEASE);
+#ifdef MM_THREADS
+	pthread_mutex_unlock(&registry_lock);
+#endif
+	return slot != NULL || entry == NULL;
+}
+
+/*
+ * registry_set_pages - record entry for each page of the size bytes
+ *     at p, leaving none of them recorded if that fails
+ */
+static int registry_set_pages(void *p, size_t size, void *entry)
+{
+	size_t i;
+
+	for (i = 0; i < size; i += APAGE_SIZE) {
+		if (!registry_set((char *)p + i, entry)) {
+			while (i > 0) {
+				i -= APAGE_SIZE;
+				registry_set((char *)p + i, NULL);
+			}
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * check_chunk_entry - Check that a chunk page's registry entry names
+ *     the start of a chunk that covers the page and the chunk's arena,
+ *     and that the chunk's first word leads to its descriptor
+ */
+static int check_chunk_entry(void *entry, char *p)
+{
+	char *start = REG_CHUNK_START(entry);
+	arena *a;
+	span *s;
+
+	if (((uintptr_t)entry & (APAGE_SIZE - 1)) >> ALIGN_SIZE_LOG2 >= ARENA_COUNT)
+		return 0;
+	a = REG_CHUNK_ARENA(entry);
+	if (!ptr_is_mapped(start, WSIZE))
+		return 0;
+	s = CHUNK_SPAN(start);
+	if (SPAN_END(s) != ADDRESS_PAGE_START(SPAN_END(s)) || !ptr_is_mapped(s, sizeof(span)))
+		return 0;
+	return s->arena == a && s->free == 0 && s->size == PAGE_ALIGN(s->size)
+		&& SPAN_START(s) == start && p >= start && p < SPAN_END(s);
+}
+
+/*
+ * check_registry_node - Check a registry node and everything below it,
+ *     counting nodes and entries; every entry must be tagged as a valid
+ *     slab page or large mapping that is its own page, or as a page of
+ *     a chunk
+ */
+static int check_registry_node(void **node, int level, uintptr_t key, size_t *nodes,
+                               size_t *entries, size_t expected)
+{
+	int i;
+	uintptr_t sub;
+
+	if (node != ADDRESS_PAGE_START(node) || !ptr_is_mapped(node, APAGE_SIZE))
+		return 0;
+	if (++*nodes > reg_nodes)
+		return 0;
+
+	for (i = 0; i < REG_FANOUT; i++) {
+		if (node[i] == NULL)
+			continue;
+		sub = (key << REG_BITS) | i;
+		if (level > 0) {
+			if (!check_registry_node(node[i], level - 1, sub, nodes, entries, expected))
+				return 0;
+		} else {
+			if (++*entries > expected)
+				return 0;
+			if (REG_KIND(node[i]) == REG_CHUNK) {
+				if (!check_chunk_entry(node[i], (char *)(sub << LOG_APAGE_SIZE)))
+					return 0;
+				continue;
+			}
+			if (REG_OWNER(node[i]) != (void *)(sub << LOG_APAGE_SIZE))
+				return 0;
+			if (REG_KIND(node[i]) == REG_SLAB) {
+				if (!check_slab(REG_OWNER(node[i])))
+					return 0;
+			} else if (REG_KIND(node[i]) == REG_LARGE) {
+				if (!check_large_block(REG_OWNER(node[i])))
+					return 0;
+			} else
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * check_registry - Check the registry tree, which must hold exactly
+ *     expected entries
+ */
+static int check_registry(size_t expected)
+{
+	size_t nodes = 0, entries = 0;
+	uintptr_t top;
+
+	for (top = 0; top < REG_ROOT_FANOUT; top++) {
+		if (reg_root[top] != NULL
+		    && !check_registry_node(reg_root[top], REG_LEVELS - 1, top, &nodes, &entries, expected))
+			return 0;
+	}
+	return nodes == reg_nodes && entries == expected;
 }
@@ -3,6 +3,74 @@
 extern int mm_init(void);
 extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
+extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern size_t mm_good_size(size_t size);
+
+/* counters for one arena, filled in by mm_arena_stats */
+typedef struct {
+    size_t heap_size;         /* bytes the arena has committed now */
+    size_t heap_peak;         /* most bytes it has had committed at once */
+    unsigned long locks;      /* times its lock was taken */
+    unsigned long contended;  /* times the lock was busy when taken */
+    int threads;              /* threads currently assigned to it */
+    unsigned long remote_frees; /* blocks other threads freed through its remote list */
+    size_t retained;          /* bytes of emptied chunks kept mapped for reuse */
+    unsigned long retain_hits;     /* chunks started in retained memory */
+    unsigned long retain_misses;   /* chunks that had to be mapped instead */
+    unsigned long retain_releases; /* retained spans unmapped by decay or the limit */
+} mm_arena_stats_t;
+
+extern int mm_arena_count(void);
+extern int mm_arena_stats(int arena, mm_arena_stats_t *stats);
+
+/* a region: blocks handed out bump-pointer style from chunks of its own,
+   with no headers, and all freed at once by mm_region_destroy; a region
+   takes no lock, so only one thread may use it at a time */
+typedef struct mm_region mm_region_t;
+
+extern mm_region_t *mm_region_create(void);
+extern void *mm_region_malloc(mm_region_t *r, size_t size);
+extern void mm_region_destroy(mm_region_t *r);
+
+/* counters for the whole allocator since mm_init, filled in by mm_get_stats;
+   blocks are counted in the slab class of their size, as chunk blocks or as
+   large mappings, in that order */
+#define MM_STATS_CLASSES 64
+typedef struct {
+    int classes;              /* entries used in the arrays below */
+    size_t class_size[MM_STATS_CLASSES];     /* largest request of each class, 0 for no limit */
+    unsigned long mallocs[MM_STATS_CLASSES]; /* blocks handed out */
+    unsigned long frees[MM_STATS_CLASSES];   /* blocks freed */
+    unsigned long splits;     /* free chunk blocks split to serve a request */
+    unsigned long coalesces;  /* chunk blocks merged with a free neighbour */
+    unsigned long extends;    /* times a chunk had to grow or be added */
+    unsigned long searches;   /* searches of the free block index */
+    unsigned long search_steps; /* bins and size tree nodes they looked at */
+    unsigned long chunk_releases; /* chunks emptied and turned back into free spans */
+    unsigned long huge_spans; /* spans mapped in huge pages, once the heap is large enough */
+    size_t mapped_bytes;      /* bytes taken with mem_map */
+    size_t unmapped_bytes;    /* bytes given back with mem_unmap */
+    size_t cached_bytes;      /* freed bytes held in quick lists, thread caches, the large cache and retained spans */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
+
+/* options for mm_setopt */
+#define MM_OPT_REMOTE_FREE 1  /* free other arenas' blocks without their lock (1, threads only) */
+#define MM_OPT_RETAIN_LIMIT 2 /* bytes of emptied chunks each arena keeps mapped (1 MB at 4K pages) */
+#define MM_OPT_PURGE_BYTES 3  /* smallest free block that decommits its pages, 0 for none (128 KB) */
+#define MM_OPT_CHECK_FULL 4   /* mm_check walks the whole heap every this many calls, only what changed in between (1) */
+#define MM_OPT_SAMPLE_BYTES 5 /* mean bytes allocated between blocks sampled for the heap profile, 0 for none (0) */
+#define MM_OPT_ADDRESS_ORDER 6 /* keep every free bin in address order within a size, from the next mm_init (0) */
+
+extern int mm_setopt(int option, long value);
+extern int mm_heap_profile_dump(FILE *f);
 
 extern int mm_check(void);
 extern int mm_can_free(void *ptr);
@@ -9,6 +9,7 @@
 typedef struct mpage {
   void *addr;
   struct mpage *prev, *next;
+  int decommitted;
 } mpage;
 
 static mpage *all_mapped_pages;
@@ -56,6 +57,7 @@ void pagemap_modify(void *p, int mapped) {
     if (page == all_mapped_pages)
       abort();
     page->addr = p;
+    page->decommitted = 0;
     page->prev = NULL;
     page->next = all_mapped_pages;
     if (all_mapped_pages)
@@ -76,16 +78,43 @@ void pagemap_modify(void *p, int mapped) {
   }
 }
 
-int pagemap_is_mapped(void *p) {
+static mpage *pagemap_find(void *p) {
   mpage **page_maps2;
   mpage *page_maps3;
 
-  if (!page_maps1) return 0;
+  if (!page_maps1) return NULL;
   page_maps2 = page_maps1[PAGEMAP64_LEVEL1_BITS(p)];
-  if (!page_maps2) return 0;
+  if (!page_maps2) return NULL;
   page_maps3 = page_maps2[PAGEMAP64_LEVEL2_BITS(p)];
-  if (!page_maps3) return 0;
-  return !!page_maps3[PAGEMAP64_LEVEL3_BITS(p)].addr;
+  if (!page_maps3) return NULL;
+  return &page_maps3[PAGEMAP64_LEVEL3_BITS(p)];
+}
+
+int pagemap_is_mapped(void *p) {
+  mpage *page = pagemap_find(p);
+
+  return page && page->addr;
+}
+
+/* Mark a mapped page as committed or not; returns whether that
+   changed anything. */
+int pagemap_set_committed(void *p, int committed) {
+  mpage *page = pagemap_find(p);
+
+  if (!page || !page->addr) {
+    fprintf(stderr, "internal error: not currently mapped\n");
+    abort();
+  }
+  if (page->decommitted == !committed)
+    return 0;
+  page->decommitted = !committed;
+  return 1;
+}
+
+int pagemap_is_committed(void *p) {
+  mpage *page = pagemap_find(p);
+
+  return page && page->addr && !page->decommitted;
 }
 
 void pagemap_for_each(page_callback f, int do_unmap) {
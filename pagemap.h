@@ -3,6 +3,8 @@ typedef void (*page_callback)(void *addr);
 
 void pagemap_modify(void *addr, int mapped);
 int pagemap_is_mapped(void *addr);
+int pagemap_set_committed(void *addr, int committed);
+int pagemap_is_committed(void *addr);
 void pagemap_for_each(page_callback f, int do_unmap);
 
 /* APAGE_SIZE needs to match the actual page size */
@@ -0,0 +1,211 @@
+/*
+ * sizeclasses.c - compute the slab size classes from tracefiles
+ *
+ * Reads the alloc, calloc and realloc requests of one or more
+ * tracefiles, in the format mdriver reads, and picks at most a given
+ * number of size classes up to a maximum size so that the bytes lost
+ * to rounding requests up to their class are as few as possible over
+ * all the requests. Classes are multiples of ALIGNMENT and the largest
+ * is always the maximum size, so every size up to it has a class. The
+ * maximum can be no more than MAX_CLASS, the room in a slab page.
+ * Memalign requests are skipped, as aligned blocks never come from a
+ * slab.
+ *
+ * The result is written as a header that mm.c compiles in: the class
+ * sizes, and a table mapping (size-1)/ALIGNMENT to a class.
+ *
+ * usage: sizeclasses [-n <classes>] [-m <max>] [-o <header>] <tracefile>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ALIGNMENT 16       /* must match mm.c */
+#define MAX_CLASS 4032     /* a 4 KB slab page less its header in mm.c */
+#define MAXLINE 1024
+
+/* requests per ALIGNMENT step, by count and by total bytes */
+static double *counts;
+static double *bytes;
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: sizeclasses [-n <classes>] [-m <max>] [-o <header>] <tracefile>...\n");
+    fprintf(stderr, "\t-n <classes>  Use at most <classes> classes (default 16).\n");
+    fprintf(stderr, "\t-m <max>      Size of the largest class, at most %d (default 256).\n", MAX_CLASS);
+    fprintf(stderr, "\t-o <header>   Write the header to <header> (default stdout).\n");
+}
+
+/*
+ * read_sizes - Count the request sizes of one tracefile that are at
+ *     most max, skipping the four header lines
+ */
+static void read_sizes(char *path, int max)
+{
+    FILE *f;
+    char type[MAXLINE];
+    unsigned index, size, align;
+    int i, header;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    for (i = 0; i < 4; i++)
+        if (fscanf(f, "%d", &header) != 1) {
+            fprintf(stderr, "%s: bad tracefile header\n", path);
+            exit(1);
+        }
+    while (fscanf(f, "%s", type) != EOF) {
+        switch (type[0]) {
+        case 'a':
+        case 'c':
+        case 'r':
+            if (fscanf(f, "%u %u", &index, &size) != 2) {
+                fprintf(stderr, "%s: bad request line\n", path);
+                exit(1);
+            }
+            if (size > 0 && size <= (unsigned)max) {
+                counts[(size - 1) / ALIGNMENT]++;
+                bytes[(size - 1) / ALIGNMENT] += size;
+            }
+            break;
+        case 'm':
+            if (fscanf(f, "%u %u %u", &index, &align, &size) != 3) {
+                fprintf(stderr, "%s: bad request line\n", path);
+                exit(1);
+            }
+            break;
+        case 'f':
+            if (fscanf(f, "%u", &index) != 1) {
+                fprintf(stderr, "%s: bad request line\n", path);
+                exit(1);
+            }
+            break;
+        default:
+            fprintf(stderr, "%s: bogus type character (%c)\n", path, type[0]);
+            exit(1);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    int classes = 16, max = 256, steps, n, i, j, k, c;
+    char *out = NULL;
+    FILE *f = stdout;
+    double *count_sum, *byte_sum, **cost, waste, total;
+    int **from, *ends;
+
+    while ((c = getopt(argc, argv, "n:m:o:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            classes = atoi(optarg);
+            break;
+        case 'm':
+            max = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc || classes < 1 || max < ALIGNMENT || max > MAX_CLASS
+        || max % ALIGNMENT != 0) {
+        usage();
+        exit(1);
+    }
+
+    steps = max / ALIGNMENT;
+    counts = calloc(steps, sizeof(double));
+    bytes = calloc(steps, sizeof(double));
+    for (i = optind; i < argc; i++)
+        read_sizes(argv[i], max);
+
+    /* prefix sums, so a class's waste is one subtraction */
+    count_sum = calloc(steps + 1, sizeof(double));
+    byte_sum = calloc(steps + 1, sizeof(double));
+    for (i = 0; i < steps; i++) {
+        count_sum[i + 1] = count_sum[i] + counts[i];
+        byte_sum[i + 1] = byte_sum[i] + bytes[i];
+    }
+    if (classes > steps)
+        classes = steps;
+
+    /*
+     * cost[k][j] is the least waste for the requests of the first j
+     * steps using k classes, the last of them ending at step j;
+     * from[k][j] is where that last class starts.
+     */
+    cost = malloc((classes + 1) * sizeof(double *));
+    from = malloc((classes + 1) * sizeof(int *));
+    for (k = 0; k <= classes; k++) {
+        cost[k] = malloc((steps + 1) * sizeof(double));
+        from[k] = calloc(steps + 1, sizeof(int));
+        for (j = 0; j <= steps; j++)
+            cost[k][j] = -1;
+    }
+    cost[0][0] = 0;
+    for (k = 1; k <= classes; k++)
+        for (j = 1; j <= steps; j++)
+            for (i = k - 1; i < j; i++) {
+                if (cost[k - 1][i] < 0)
+                    continue;
+                waste = cost[k - 1][i] + (double)j * ALIGNMENT * (count_sum[j] - count_sum[i])
+                    - (byte_sum[j] - byte_sum[i]);
+                if (cost[k][j] < 0 || waste < cost[k][j]) {
+                    cost[k][j] = waste;
+                    from[k][j] = i;
+                }
+            }
+
+    /* the fewest classes that reach the least waste */
+    n = 1;
+    for (k = 1; k <= classes; k++)
+        if (cost[k][steps] < cost[n][steps])
+            n = k;
+    ends = malloc(n * sizeof(int));
+    for (k = n, j = steps; k > 0; j = from[k][j], k--)
+        ends[k - 1] = j;
+
+    if (out != NULL && (f = fopen(out, "w")) == NULL) {
+        perror(out);
+        exit(1);
+    }
+    total = byte_sum[steps];
+    fprintf(f, "/*\n * sizeclasses.h - slab size classes, generated by sizeclasses from\n");
+    for (i = optind; i < argc; i++)
+        fprintf(f, " *   %s\n", argv[i]);
+    fprintf(f, " *\n * %d classes up to %d bytes lose %.2f%% of the %.0f requested bytes\n"
+            " * to rounding. Do not edit; regenerate with make classes.\n */\n",
+            n, max, total > 0 ? 100.0 * cost[n][steps] / total : 0.0, total);
+    fprintf(f, "#define SIZE_CLASS_COUNT %d\n", n);
+    fprintf(f, "#define SIZE_CLASS_MAX %d\n\n", max);
+
+    fprintf(f, "//slot size of each class\n");
+    fprintf(f, "static const unsigned short size_class_size[SIZE_CLASS_COUNT] = {");
+    for (k = 0; k < n; k++)
+        fprintf(f, "%s%s%d", k ? "," : "", k % 8 ? " " : "\n\t", ends[k] * ALIGNMENT);
+    fprintf(f, "\n};\n\n");
+
+    fprintf(f, "//class of a size, indexed by (size-1)/%d\n", ALIGNMENT);
+    fprintf(f, "static const unsigned char size_class_index[SIZE_CLASS_MAX / %d] = {", ALIGNMENT);
+    for (i = 0, k = 0; i < steps; i++) {
+        if (i >= ends[k])
+            k++;
+        fprintf(f, "%s%s%d", i ? "," : "", i % 16 ? " " : "\n\t", k);
+    }
+    fprintf(f, "\n};\n");
+
+    if (out != NULL)
+        fclose(f);
+    return 0;
+}
@@ -81,6 +81,12 @@ while ($line = <STDIN>) {
     # save the line for output later
     $lines[$requestnum++] = $line;
 
+    # calloc and memalign requests allocate a block just like an
+    # alloc request
+    if ($cmd eq "c" or $cmd eq "m") {
+	$cmd = "a";
+    }
+
     #ignore realloc requests, as long as they are preceeded by an alloc request
     if ($cmd eq "r") {
 	if (!$HASH{$id}) {
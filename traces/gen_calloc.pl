@@ -0,0 +1,46 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = "calloc.rep";
+$num_rounds = 50;
+$blocks_per_round = 48;
+@sizes = (24, 200, 640, 1800, 5000, 24000, 80000);
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Each round callocs a batch of blocks, one in four malloc'd instead,
+# and then frees the batch before it, so all but the first round reuse
+# memory that has been written
+$total_block_size = 0;
+for ($i = 0;  $i < $num_rounds; $i += 1) {
+    for ($j = 0;  $j < $blocks_per_round; $j += 1) {
+        $blk = $i * $blocks_per_round + $j;
+        $size = $sizes[$blk % @sizes];
+        $type = ($j % 4 == 3) ? "a" : "c";
+        push @trace, "$type $blk $size";
+        $total_block_size += $size;
+    }
+    if ($i > 0) {
+        for ($j = 0;  $j < $blocks_per_round; $j += 1) {
+            $blk = ($i - 1) * $blocks_per_round + $j;
+            push @trace, "f $blk";
+        }
+    }
+}
+
+# Calculate misc parameters
+$suggested_heap_size = $total_block_size + 100;
+$num_blocks = $num_rounds * $blocks_per_round;
+$num_ops = scalar @trace;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $line (@trace) {
+    print OUTFILE "$line\n";
+}
+
+close OUTFILE;
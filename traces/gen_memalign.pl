@@ -0,0 +1,54 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = "memalign.rep";
+$num_rounds = 40;
+$blocks_per_round = 40;
+@sizes = (48, 100, 512, 1500, 4096, 9000, 64);
+@aligns = (64, 4096, 32, 256, 64);
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Each round memaligns a batch of blocks, one in three malloc'd
+# instead, then frees the odd blocks of the round before and the even
+# blocks of the round before that, so the aligned blocks are carved
+# from a heap full of holes
+$total_block_size = 0;
+for ($i = 0;  $i < $num_rounds; $i += 1) {
+    for ($j = 0;  $j < $blocks_per_round; $j += 1) {
+        $blk = $i * $blocks_per_round + $j;
+        $size = $sizes[$blk % @sizes];
+        if ($j % 3 == 2) {
+            push @trace, "a $blk $size";
+        } else {
+            $align = $aligns[$blk % @aligns];
+            push @trace, "m $blk $align $size";
+        }
+        $total_block_size += $size;
+    }
+    for ($j = 1;  $i > 0 && $j < $blocks_per_round; $j += 2) {
+        $blk = ($i - 1) * $blocks_per_round + $j;
+        push @trace, "f $blk";
+    }
+    for ($j = 0;  $i > 1 && $j < $blocks_per_round; $j += 2) {
+        $blk = ($i - 2) * $blocks_per_round + $j;
+        push @trace, "f $blk";
+    }
+}
+
+# Calculate misc parameters
+$suggested_heap_size = $total_block_size + 100;
+$num_blocks = $num_rounds * $blocks_per_round;
+$num_ops = scalar @trace;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $line (@trace) {
+    print OUTFILE "$line\n";
+}
+
+close OUTFILE;